@@ -0,0 +1,349 @@
+//============================================================================
+// Name        : GridValidator.h
+// Author      : Jeff Hancock
+//               https://www.linkedin.com/in/jeffreythancock/
+// Copyright   : Carte blanche.  Plagiarize at will.
+// Description : Checks completed 9x9 grids in bulk, many at a time with SIMD
+//               instructions where the CPU has them.
+//============================================================================
+
+#ifndef GRIDVALIDATOR_H
+#define GRIDVALIDATOR_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <algorithm>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define GRIDVALIDATOR_X86 1
+#endif
+
+// The bytes in one grid: its 81 values, one per byte, row by row.
+constexpr size_t GRID_BYTES = 81;
+
+// The ways validateGrids() can do its work, slowest first.
+enum class ValidatorKind {
+    // One grid at a time, with plain C++.
+    SCALAR,
+    // 16 grids at a time, with SSE4.1.
+    SSE4,
+    // 32 grids at a time, with AVX2.
+    AVX2
+};
+
+// The fastest ValidatorKind this CPU supports.  Worked out once.
+inline ValidatorKind bestValidator() {
+#ifdef GRIDVALIDATOR_X86
+    static const ValidatorKind best = __builtin_cpu_supports("avx2") ? ValidatorKind::AVX2 :
+                                      __builtin_cpu_supports("sse4.1") ? ValidatorKind::SSE4 : ValidatorKind::SCALAR;
+    return best;
+#else
+    return ValidatorKind::SCALAR;
+#endif
+}
+
+inline const char* validatorName(const ValidatorKind kind) {
+    switch (kind) {
+    case ValidatorKind::SSE4: return "sse4";
+    case ValidatorKind::AVX2: return "avx2";
+    default: return "scalar";
+    }
+}
+
+// Check one grid.
+// Return value:
+//    true - every value is 1 - 9 and every row, column and box has each of them once
+//    false - it doesn't
+inline bool isGridValid(const uint8_t* grid) {
+    uint16_t rows[9] = {}, cols[9] = {}, boxes[9] = {};
+    for (int row=0; row < 9; row++) {
+        for (int col=0; col < 9; col++) {
+            unsigned value = grid[9 * row + col];
+            if (value < 1 || value > 9) return false;
+            uint16_t bit = uint16_t(1u << (value - 1));
+            rows[row] |= bit;
+            cols[col] |= bit;
+            boxes[3 * (row / 3) + col / 3] |= bit;
+        }
+    }
+    // Nine cells with all nine values between them can't have a repeat.
+    for (int idx=0; idx < 9; idx++) {
+        if ((rows[idx] & cols[idx] & boxes[idx]) != 0x1FF) return false;
+    }
+    return true;
+}
+
+// Everything wrong with one grid, as found by findViolations().  Units are numbered
+// 0 - 26: rows 0 - 8, then columns (9 - 17), then boxes (18 - 26, row by row).  Value
+// sets have bit (value - 1) set for each value in them.
+struct GridViolations {
+    // The values that appear more than once in each unit.
+    uint16_t repeats[27];
+    // The cells (9 * row + col) whose values aren't 1 - 9: bit (cell % 64) of
+    // badCells[cell / 64].
+    uint64_t badCells[2];
+    // The units with a repeat or a bad value in them: bit unit.
+    uint32_t badUnits;
+
+    bool ok() const {
+        return badUnits == 0;
+    }
+    bool isBadCell(const int cell) const {
+        return (badCells[cell / 64] >> (cell % 64) & 1) != 0;
+    }
+    // Whether the cell at row, col holding value is out of range or one of a repeat,
+    // i.e. whether to highlight it.
+    bool isConflict(const int row, const int col, const int value) const {
+        if (isBadCell(9 * row + col)) return true;
+        unsigned bit = 1u << (value - 1);
+        return ((repeats[row] | repeats[9 + col] | repeats[18 + 3 * (row / 3) + col / 3]) & bit) != 0;
+    }
+};
+
+// Check one completed grid (81 values, row by row, of any integer type) in a single
+// pass, recording every repeated value, every value out of range and every unit they
+// spoil.  No allocation and no output.
+// Return value:
+//    true - the grid is a valid solution
+//    false - it isn't; violations says why
+template <typename Cell>
+bool findViolations(const Cell* grid, GridViolations& violations) {
+    uint16_t seen[27] = {};
+    memset(&violations, 0, sizeof(violations));
+    for (int row=0; row < 9; row++) {
+        for (int col=0; col < 9; col++) {
+            const int cell = 9 * row + col;
+            const int units[3] = { row, 9 + col, 18 + 3 * (row / 3) + col / 3 };
+            const long long value = (long long)(grid[cell]);
+            if (value < 1 || value > 9) {
+                violations.badCells[cell / 64] |= uint64_t(1) << (cell % 64);
+                for (int unit : units) violations.badUnits |= 1u << unit;
+                continue;
+            }
+            const uint16_t bit = uint16_t(1u << (value - 1));
+            for (int unit : units) {
+                if ((seen[unit] & bit) != 0) {
+                    violations.repeats[unit] |= bit;
+                    violations.badUnits |= 1u << unit;
+                }
+                seen[unit] |= bit;
+            }
+        }
+    }
+    return violations.ok();
+}
+
+#ifdef GRIDVALIDATOR_X86
+
+// The SIMD versions work on one byte per grid, so a vector holds the same cell of 16
+// or 32 grids and each step checks that many.  A byte only has room for eight of the
+// nine values, so the unit masks cover 1 - 8, and the nines are counted instead: if
+// every value is 1 - 9, every unit has each of 1 - 8, and there are nine nines, then
+// each row (and column and box) has room for at most one nine, so has exactly one,
+// and its other eight cells are 1 - 8 once each.
+//
+// The grids are 81 bytes apart, so each 16 cells of 16 grids are loaded as rows and
+// transposed to get one vector per cell.  Cells 64 - 79 and 65 - 80 overlap so that
+// nothing is read past the end of the last grid.
+
+// Transpose a 16x16 matrix of bytes held one row per vector: interleave pairs of
+// rows a byte at a time, then pairs of those two bytes at a time, and so on.  With
+// AVX2, each 128 bit lane holds a separate matrix.
+[[gnu::target("avx2")]]
+inline void transposeBytesAvx2(__m256i (&rows)[16]) {
+    __m256i a[16], b[16];
+    for (int idx=0; idx < 8; idx++) {
+        a[2 * idx] = _mm256_unpacklo_epi8(rows[2 * idx], rows[2 * idx + 1]);
+        a[2 * idx + 1] = _mm256_unpackhi_epi8(rows[2 * idx], rows[2 * idx + 1]);
+    }
+    for (int group=0; group < 16; group += 4) {
+        b[group] = _mm256_unpacklo_epi16(a[group], a[group + 2]);
+        b[group + 1] = _mm256_unpackhi_epi16(a[group], a[group + 2]);
+        b[group + 2] = _mm256_unpacklo_epi16(a[group + 1], a[group + 3]);
+        b[group + 3] = _mm256_unpackhi_epi16(a[group + 1], a[group + 3]);
+    }
+    for (int half=0; half < 16; half += 8) {
+        for (int idx=0; idx < 4; idx++) {
+            a[half + 2 * idx] = _mm256_unpacklo_epi32(b[half + idx], b[half + idx + 4]);
+            a[half + 2 * idx + 1] = _mm256_unpackhi_epi32(b[half + idx], b[half + idx + 4]);
+        }
+    }
+    for (int idx=0; idx < 8; idx++) {
+        rows[2 * idx] = _mm256_unpacklo_epi64(a[idx], a[idx + 8]);
+        rows[2 * idx + 1] = _mm256_unpackhi_epi64(a[idx], a[idx + 8]);
+    }
+}
+
+[[gnu::target("sse4.1")]]
+inline void transposeBytesSse4(__m128i (&rows)[16]) {
+    __m128i a[16], b[16];
+    for (int idx=0; idx < 8; idx++) {
+        a[2 * idx] = _mm_unpacklo_epi8(rows[2 * idx], rows[2 * idx + 1]);
+        a[2 * idx + 1] = _mm_unpackhi_epi8(rows[2 * idx], rows[2 * idx + 1]);
+    }
+    for (int group=0; group < 16; group += 4) {
+        b[group] = _mm_unpacklo_epi16(a[group], a[group + 2]);
+        b[group + 1] = _mm_unpackhi_epi16(a[group], a[group + 2]);
+        b[group + 2] = _mm_unpacklo_epi16(a[group + 1], a[group + 3]);
+        b[group + 3] = _mm_unpackhi_epi16(a[group + 1], a[group + 3]);
+    }
+    for (int half=0; half < 16; half += 8) {
+        for (int idx=0; idx < 4; idx++) {
+            a[half + 2 * idx] = _mm_unpacklo_epi32(b[half + idx], b[half + idx + 4]);
+            a[half + 2 * idx + 1] = _mm_unpackhi_epi32(b[half + idx], b[half + idx + 4]);
+        }
+    }
+    for (int idx=0; idx < 8; idx++) {
+        rows[2 * idx] = _mm_unpacklo_epi64(a[idx], a[idx + 8]);
+        rows[2 * idx + 1] = _mm_unpackhi_epi64(a[idx], a[idx + 8]);
+    }
+}
+
+// The first cell of each group of 16 loaded, and the first of those that is new.
+constexpr int CELL_GROUPS[6][2] = { { 0, 0 }, { 16, 0 }, { 32, 0 }, { 48, 0 }, { 64, 0 }, { 65, 15 } };
+
+// Check 32 grids, 81 bytes apart.
+// Return value:
+//    Bit idx set if grid idx is valid.
+[[gnu::target("avx2")]]
+inline uint32_t validateBlockAvx2(const uint8_t* grids) {
+    const __m256i one = _mm256_set1_epi8(1);
+    const __m256i eight = _mm256_set1_epi8(8);
+    const __m256i nine = _mm256_set1_epi8(9);
+    const __m256i full = _mm256_set1_epi8(-1);
+    // Indexed by value - 1: the bit for 1 - 8, nothing for 9.
+    const __m256i bits = _mm256_setr_epi8(1, 2, 4, 8, 16, 32, 64, -128, 0, 0, 0, 0, 0, 0, 0, 0,
+                                          1, 2, 4, 8, 16, 32, 64, -128, 0, 0, 0, 0, 0, 0, 0, 0);
+    __m256i cols[9], boxes[3];
+    for (__m256i& mask : cols) mask = _mm256_setzero_si256();
+    for (__m256i& mask : boxes) mask = _mm256_setzero_si256();
+    __m256i row = _mm256_setzero_si256();
+    __m256i highest = _mm256_setzero_si256();
+    __m256i nines = _mm256_setzero_si256();
+    __m256i ok = full;
+
+    for (const auto& group : CELL_GROUPS) {
+        __m256i cells[16];
+        for (int idx=0; idx < 16; idx++) {
+            __m128i low = _mm_loadu_si128(reinterpret_cast<const __m128i*>(grids + idx * GRID_BYTES + group[0]));
+            __m128i high = _mm_loadu_si128(reinterpret_cast<const __m128i*>(grids + (idx + 16) * GRID_BYTES + group[0]));
+            cells[idx] = _mm256_inserti128_si256(_mm256_castsi128_si256(low), high, 1);
+        }
+        transposeBytesAvx2(cells);
+
+        for (int idx=group[1]; idx < 16; idx++) {
+            const int cell = group[0] + idx, col = cell % 9;
+            // value - 1 wraps round for 0, so anything out of range ends up above 8.
+            __m256i value = _mm256_sub_epi8(cells[idx], one);
+            highest = _mm256_max_epu8(highest, value);
+            nines = _mm256_sub_epi8(nines, _mm256_cmpeq_epi8(cells[idx], nine));
+            __m256i bit = _mm256_shuffle_epi8(bits, value);
+            row = _mm256_or_si256(row, bit);
+            cols[col] = _mm256_or_si256(cols[col], bit);
+            boxes[col / 3] = _mm256_or_si256(boxes[col / 3], bit);
+            if (col == 8) {
+                ok = _mm256_and_si256(ok, _mm256_cmpeq_epi8(row, full));
+                row = _mm256_setzero_si256();
+                if (cell / 9 % 3 == 2) {
+                    for (__m256i& mask : boxes) {
+                        ok = _mm256_and_si256(ok, _mm256_cmpeq_epi8(mask, full));
+                        mask = _mm256_setzero_si256();
+                    }
+                }
+            }
+        }
+    }
+    for (const __m256i& mask : cols) {
+        ok = _mm256_and_si256(ok, _mm256_cmpeq_epi8(mask, full));
+    }
+    ok = _mm256_and_si256(ok, _mm256_cmpeq_epi8(_mm256_max_epu8(highest, eight), eight));
+    ok = _mm256_and_si256(ok, _mm256_cmpeq_epi8(nines, nine));
+    return uint32_t(_mm256_movemask_epi8(ok));
+}
+
+// Check 16 grids, 81 bytes apart, as validateBlockAvx2() does 32.
+[[gnu::target("sse4.1")]]
+inline uint32_t validateBlockSse4(const uint8_t* grids) {
+    const __m128i one = _mm_set1_epi8(1);
+    const __m128i eight = _mm_set1_epi8(8);
+    const __m128i nine = _mm_set1_epi8(9);
+    const __m128i full = _mm_set1_epi8(-1);
+    const __m128i bits = _mm_setr_epi8(1, 2, 4, 8, 16, 32, 64, -128, 0, 0, 0, 0, 0, 0, 0, 0);
+    __m128i cols[9], boxes[3];
+    for (__m128i& mask : cols) mask = _mm_setzero_si128();
+    for (__m128i& mask : boxes) mask = _mm_setzero_si128();
+    __m128i row = _mm_setzero_si128();
+    __m128i highest = _mm_setzero_si128();
+    __m128i nines = _mm_setzero_si128();
+    __m128i ok = full;
+
+    for (const auto& group : CELL_GROUPS) {
+        __m128i cells[16];
+        for (int idx=0; idx < 16; idx++) {
+            cells[idx] = _mm_loadu_si128(reinterpret_cast<const __m128i*>(grids + idx * GRID_BYTES + group[0]));
+        }
+        transposeBytesSse4(cells);
+
+        for (int idx=group[1]; idx < 16; idx++) {
+            const int cell = group[0] + idx, col = cell % 9;
+            __m128i value = _mm_sub_epi8(cells[idx], one);
+            highest = _mm_max_epu8(highest, value);
+            nines = _mm_sub_epi8(nines, _mm_cmpeq_epi8(cells[idx], nine));
+            __m128i bit = _mm_shuffle_epi8(bits, value);
+            row = _mm_or_si128(row, bit);
+            cols[col] = _mm_or_si128(cols[col], bit);
+            boxes[col / 3] = _mm_or_si128(boxes[col / 3], bit);
+            if (col == 8) {
+                ok = _mm_and_si128(ok, _mm_cmpeq_epi8(row, full));
+                row = _mm_setzero_si128();
+                if (cell / 9 % 3 == 2) {
+                    for (__m128i& mask : boxes) {
+                        ok = _mm_and_si128(ok, _mm_cmpeq_epi8(mask, full));
+                        mask = _mm_setzero_si128();
+                    }
+                }
+            }
+        }
+    }
+    for (const __m128i& mask : cols) {
+        ok = _mm_and_si128(ok, _mm_cmpeq_epi8(mask, full));
+    }
+    ok = _mm_and_si128(ok, _mm_cmpeq_epi8(_mm_max_epu8(highest, eight), eight));
+    ok = _mm_and_si128(ok, _mm_cmpeq_epi8(nines, nine));
+    return uint32_t(_mm_movemask_epi8(ok));
+}
+
+#endif // GRIDVALIDATOR_X86
+
+// Check count completed grids stored one after another, GRID_BYTES each.  Bit
+// (idx % 64) of passed[idx / 64] is set if grid idx is valid (as isGridValid()) and
+// cleared if not; passed needs (count + 63) / 64 words.  kind picks the code used, for
+// testing and comparing them; one the CPU doesn't support falls back to the best it
+// does.
+inline void validateGrids(const uint8_t* grids, const size_t count, uint64_t* passed,
+                          ValidatorKind kind = bestValidator()) {
+    kind = std::min(kind, bestValidator());
+    memset(passed, 0, (count + 63) / 64 * sizeof(uint64_t));
+    size_t idx = 0;
+#ifdef GRIDVALIDATOR_X86
+    // The blocks start at multiples of their size, so each one's bits fall within a
+    // single word.
+    if (kind == ValidatorKind::AVX2) {
+        for (; idx + 32 <= count; idx += 32) {
+            passed[idx / 64] |= uint64_t(validateBlockAvx2(grids + idx * GRID_BYTES)) << (idx % 64);
+        }
+    }
+    if (kind >= ValidatorKind::SSE4) {
+        for (; idx + 16 <= count; idx += 16) {
+            passed[idx / 64] |= uint64_t(validateBlockSse4(grids + idx * GRID_BYTES)) << (idx % 64);
+        }
+    }
+#endif
+    for (; idx < count; idx++) {
+        if (isGridValid(grids + idx * GRID_BYTES)) passed[idx / 64] |= uint64_t(1) << (idx % 64);
+    }
+}
+
+#endif // GRIDVALIDATOR_H
@@ -0,0 +1,257 @@
+//============================================================================
+// Name        : MultiPuzzleSolver.h
+// Author      : Jeff Hancock
+//               https://www.linkedin.com/in/jeffreythancock/
+// Copyright   : Carte blanche.  Plagiarize at will.
+// Description : Solves 9x9 puzzles in bulk.  Naked and hidden singles are
+//               found for 8, 16 or 32 puzzles at once, one puzzle per SIMD
+//               lane; only puzzles that need guessing go on to SudokuPuzzle.
+//============================================================================
+
+#ifndef MULTIPUZZLESOLVER_H
+#define MULTIPUZZLESOLVER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <algorithm>
+#include "SudokuPuzzle.h"
+
+// The ways solveMany() can propagate, slowest first.
+enum class LaneKind {
+    // 8 puzzles at a time with plain C++ (which the compiler turns into SSE2 on x86).
+    PORTABLE,
+    // 16 puzzles at a time, with AVX2.
+    AVX2,
+    // 32 puzzles at a time, with AVX-512.
+    AVX512
+};
+
+// The fastest LaneKind this CPU supports.  Worked out once.
+inline LaneKind bestLaneKind() {
+#if defined(__x86_64__) || defined(__i386__)
+    static const LaneKind best = __builtin_cpu_supports("avx512bw") ? LaneKind::AVX512 :
+                                 __builtin_cpu_supports("avx2") ? LaneKind::AVX2 : LaneKind::PORTABLE;
+    return best;
+#else
+    return LaneKind::PORTABLE;
+#endif
+}
+
+inline const char* laneKindName(const LaneKind kind) {
+    switch (kind) {
+    case LaneKind::AVX2: return "avx2";
+    case LaneKind::AVX512: return "avx512";
+    default: return "portable";
+    }
+}
+
+// How solveMany() got on.
+struct MultiSolveStats {
+    // Puzzles finished by propagation alone: solved, or found to have no solution.
+    size_t propagated = 0;
+    // Puzzles that had to be searched.
+    size_t searched = 0;
+};
+
+namespace MultiPuzzle {
+    typedef GridShape<3, 3> Shape;
+    constexpr int NUM_SPOTS = Shape::NUM_SPOTS;
+    constexpr uint16_t ALL = Shape::ALL_CANDIDATES;
+    inline constexpr UnitTable<3, 3> UNITS{};
+
+    // What propagation left a puzzle as.
+    enum LaneState : uint8_t { OPEN, SOLVED, UNSOLVABLE, INVALID };
+
+    // The candidates of one spot in each of LANES puzzles.
+    template <int LANES>
+    struct LaneVector {
+        typedef uint16_t type __attribute__((vector_size(2 * LANES)));
+    };
+    template <int LANES>
+    using Lanes = typename LaneVector<LANES>::type;
+
+    // Vectors are passed by reference: passing a 256 or 512 bit one by value from code
+    // built without AVX would change the ABI.
+    template <int LANES>
+    [[gnu::always_inline]] inline bool any(const Lanes<LANES>& v) {
+        uint16_t all = 0;
+        for (int lane=0; lane < LANES; lane++) all |= v[lane];
+        return all != 0;
+    }
+
+    // Load up to LANES puzzles (num of them, 81 values each, back to back), propagate
+    // singles until nothing changes, and write each back to cells with the spots that
+    // propagation settled filled in.  Lanes past num are left out of states.
+    template <int LANES>
+    [[gnu::always_inline]] inline void propagate(const uint8_t* grids, const size_t num, uint8_t* cells, LaneState* states) {
+        typedef Lanes<LANES> Vec;
+        Vec cand[NUM_SPOTS];
+        Vec invalid = {};
+        for (int spot=0; spot < NUM_SPOTS; spot++) {
+            Vec v;
+            for (int lane=0; lane < LANES; lane++) {
+                unsigned value = size_t(lane) < num ? grids[size_t(lane) * NUM_SPOTS + spot] : 0;
+                v[lane] = value == 0 ? ALL : value <= 9 ? uint16_t(1u << (value - 1)) : 0;
+                if (value > 9) invalid[lane] = 1;
+            }
+            cand[spot] = v;
+        }
+
+        Vec dead = {};
+        bool first = true;
+        bool changed = true;
+        while (changed) {
+            Vec delta = {};
+
+            // Naked singles: take each unit's settled values out of the rest of it.  On the
+            // first pass the only settled spots are the givens, so a repeat there means the
+            // puzzle is invalid rather than just unsolvable.
+            Vec settled[Shape::NUM_UNITS];
+            Vec repeated = {};
+            for (int unit=0; unit < Shape::NUM_UNITS; unit++) {
+                Vec once = {}, twice = {};
+                for (const Spot& spot : UNITS.spots[unit]) {
+                    Vec c = cand[9 * spot.row + spot.col];
+                    // The candidate where it's the only one, else zero.
+                    Vec f = c & Vec((c & (c - 1)) == 0);
+                    twice |= once & f;
+                    once |= f;
+                }
+                settled[unit] = once;
+                repeated |= twice;
+            }
+            if (first) invalid |= repeated;
+            dead |= repeated;
+            for (int row=0; row < 9; row++) {
+                for (int col=0; col < 9; col++) {
+                    Vec& c = cand[9 * row + col];
+                    Vec taken = settled[row] | settled[9 + col] | settled[18 + Shape::boxIndex(row, col)];
+                    Vec single = Vec((c & (c - 1)) == 0);
+                    Vec next = c & ~(taken & ~single);
+                    delta |= next ^ c;
+                    c = next;
+                }
+            }
+
+            // Hidden singles: a value with one place left in a unit goes there.  A value with
+            // no place, or a spot that is the only place for two values, is a dead end.
+            for (int unit=0; unit < Shape::NUM_UNITS; unit++) {
+                Vec once = {}, twice = {};
+                for (const Spot& spot : UNITS.spots[unit]) {
+                    Vec c = cand[9 * spot.row + spot.col];
+                    twice |= once & c;
+                    once |= c;
+                }
+                dead |= Vec(once != ALL);
+                Vec exactly = once & ~twice;
+                for (const Spot& spot : UNITS.spots[unit]) {
+                    Vec& c = cand[9 * spot.row + spot.col];
+                    Vec hidden = c & exactly;
+                    dead |= Vec((hidden & (hidden - 1)) != 0);
+                    Vec next = hidden != 0 ? hidden : c;
+                    delta |= next ^ c;
+                    c = next;
+                }
+            }
+
+            for (int spot=0; spot < NUM_SPOTS; spot++) {
+                dead |= Vec(cand[spot] == 0);
+            }
+            // Dead lanes needn't hold the rest up.  A lane that changed goes round again
+            // even if it's complete, so its last values are checked for repeats.
+            changed = any<LANES>(delta & ~dead);
+            first = false;
+        }
+
+        for (size_t lane=0; lane < std::min(num, size_t(LANES)); lane++) {
+            bool complete = true;
+            uint8_t* out = cells + lane * NUM_SPOTS;
+            for (int spot=0; spot < NUM_SPOTS; spot++) {
+                uint16_t c = cand[spot][lane];
+                bool single = c != 0 && (c & (c - 1)) == 0;
+                out[spot] = single ? uint8_t(lowestCandidate(c)) : 0;
+                complete &= single;
+            }
+            states[lane] = invalid[lane] ? INVALID : dead[lane] ? UNSOLVABLE : complete ? SOLVED : OPEN;
+        }
+    }
+
+    inline void propagatePortable(const uint8_t* grids, const size_t num, uint8_t* cells, LaneState* states) {
+        propagate<8>(grids, num, cells, states);
+    }
+
+#if defined(__x86_64__) || defined(__i386__)
+    [[gnu::target("avx2")]]
+    inline void propagateAvx2(const uint8_t* grids, const size_t num, uint8_t* cells, LaneState* states) {
+        propagate<16>(grids, num, cells, states);
+    }
+
+    [[gnu::target("avx512f,avx512bw")]]
+    inline void propagateAvx512(const uint8_t* grids, const size_t num, uint8_t* cells, LaneState* states) {
+        propagate<32>(grids, num, cells, states);
+    }
+#endif
+}
+
+// The number of puzzles solveMany() propagates at once with the given kind.
+inline int laneCount(const LaneKind kind) {
+    return kind == LaneKind::AVX512 ? 32 : kind == LaneKind::AVX2 ? 16 : 8;
+}
+
+// Solve count 9x9 puzzles held back to back in puzzles (81 values each, row by row,
+// zero for blank), writing the solutions the same way to solutions (which may be
+// puzzles itself) and how each went to statuses, as solveInto() would.  Puzzles that
+// propagation doesn't finish are searched with the given backend.  Nothing is
+// allocated and nothing is written to stdout or stderr.
+inline void solveMany(const uint8_t* puzzles, const size_t count, uint8_t* solutions, SolveStatus* statuses,
+                      const SolverBackend backend = SolverBackend::PROPAGATION,
+                      MultiSolveStats* stats = nullptr, const LaneKind kind = bestLaneKind()) {
+    using namespace MultiPuzzle;
+    constexpr int MAX_LANES = 32;
+    const size_t lanes = size_t(laneCount(kind));
+    uint8_t cells[MAX_LANES * NUM_SPOTS];
+    LaneState states[MAX_LANES];
+
+    for (size_t first=0; first < count; first += lanes) {
+        const size_t num = std::min(lanes, count - first);
+        const uint8_t* grids = puzzles + first * NUM_SPOTS;
+        switch (kind) {
+#if defined(__x86_64__) || defined(__i386__)
+        case LaneKind::AVX512: propagateAvx512(grids, num, cells, states); break;
+        case LaneKind::AVX2: propagateAvx2(grids, num, cells, states); break;
+#endif
+        default: propagatePortable(grids, num, cells, states); break;
+        }
+
+        for (size_t lane=0; lane < num; lane++) {
+            uint8_t* solution = solutions + (first + lane) * NUM_SPOTS;
+            const uint8_t (&settled)[NUM_SPOTS] = *reinterpret_cast<const uint8_t (*)[NUM_SPOTS]>(cells + lane * NUM_SPOTS);
+            SolveStatus& status = statuses[first + lane];
+            switch (states[lane]) {
+            case SOLVED:
+                memcpy(solution, settled, NUM_SPOTS);
+                status = SolveStatus::SOLVED;
+                break;
+            case UNSOLVABLE:
+                status = SolveStatus::UNSOLVABLE;
+                break;
+            case INVALID:
+                status = SolveStatus::INVALID;
+                break;
+            case OPEN: {
+                SudokuPuzzle sp(settled);
+                sp.setBackend(backend);
+                status = sp.solveInto(*reinterpret_cast<uint8_t (*)[NUM_SPOTS]>(solution));
+                break;
+            }
+            }
+            if (stats != nullptr) {
+                if (states[lane] == OPEN) stats->searched++;
+                else if (states[lane] != INVALID) stats->propagated++;
+            }
+        }
+    }
+}
+
+#endif // MULTIPUZZLESOLVER_H
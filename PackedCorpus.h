@@ -0,0 +1,339 @@
+//============================================================================
+// Name        : PackedCorpus.h
+// Author      : Jeff Hancock
+//               https://www.linkedin.com/in/jeffreythancock/
+// Copyright   : Carte blanche.  Plagiarize at will.
+// Description : A compact binary file of puzzles (and optionally their
+//               solutions), for archives too big to keep as text.  Each
+//               value takes 4 bits (8 for grids over 15 x 15), so a 9x9
+//               puzzle is 41 bytes.  Read through a memory mapping, with no
+//               parsing.
+//============================================================================
+
+#ifndef PACKEDCORPUS_H
+#define PACKEDCORPUS_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// The layout of a packed corpus file, all numbers little endian:
+//    0   4 bytes  "SDKP"
+//    4   2        format version (1)
+//    6   1        grid size (rows, e.g. 9)
+//    7   1        bits per value (4 or 8)
+//    8   1        flags: bit 0 set if each puzzle is followed by its solution
+//    9   7        zero
+//    16  8        number of puzzles
+//    24  8        FNV-1a hash of everything after the header
+//    32           the puzzles, each recordBytes() long: the values one row after
+//                 another, zero for a blank, two to a byte low half first when 4
+//                 bits each; then the solution the same way if there are solutions
+//                 (all zero if the puzzle has none)
+namespace PackedFormat {
+    constexpr char MAGIC[4] = { 'S', 'D', 'K', 'P' };
+    constexpr uint16_t VERSION = 1;
+    constexpr size_t HEADER_BYTES = 32;
+    constexpr uint8_t HAS_SOLUTIONS = 1;
+
+    // The bits each value takes in a grid of the given size.
+    inline int bitsPerValue(const int size) {
+        return size <= 15 ? 4 : 8;
+    }
+
+    // The bytes one grid of values takes.
+    inline size_t gridBytes(const int size, const int bits) {
+        return (size_t(size) * size_t(size) * size_t(bits) + 7) / 8;
+    }
+
+    inline void putLE(uint8_t* at, uint64_t value, const int bytes) {
+        for (int idx=0; idx < bytes; idx++, value >>= 8) at[idx] = uint8_t(value);
+    }
+
+    inline uint64_t getLE(const uint8_t* at, const int bytes) {
+        uint64_t value = 0;
+        for (int idx = bytes - 1; idx >= 0; idx--) value = (value << 8) | at[idx];
+        return value;
+    }
+
+    // Carry an FNV-1a hash on over more bytes.
+    inline uint64_t hashBytes(uint64_t hash, const uint8_t* data, const size_t count) {
+        for (size_t idx=0; idx < count; idx++) {
+            hash = (hash ^ data[idx]) * 0x100000001B3ull;
+        }
+        return hash;
+    }
+    constexpr uint64_t HASH_START = 0xCBF29CE484222325ull;
+
+    inline void packGrid(const uint8_t* cells, const int numSpots, const int bits, uint8_t* out) {
+        if (bits == 8) {
+            memcpy(out, cells, size_t(numSpots));
+            return;
+        }
+        for (int idx=0; idx + 1 < numSpots; idx += 2) {
+            out[idx / 2] = uint8_t(cells[idx] | (cells[idx + 1] << 4));
+        }
+        if (numSpots % 2 != 0) out[numSpots / 2] = cells[numSpots - 1];
+    }
+
+    inline void unpackGrid(const uint8_t* in, const int numSpots, const int bits, uint8_t* cells) {
+        if (bits == 8) {
+            memcpy(cells, in, size_t(numSpots));
+            return;
+        }
+        for (int idx=0; idx + 1 < numSpots; idx += 2) {
+            cells[idx] = in[idx / 2] & 0x0F;
+            cells[idx + 1] = in[idx / 2] >> 4;
+        }
+        if (numSpots % 2 != 0) cells[numSpots - 1] = in[numSpots / 2] & 0x0F;
+    }
+}
+
+// Reads a packed corpus through a memory mapping.  Puzzles can be had in any order,
+// or one after another with next().
+class PackedCorpus {
+
+public:
+
+    PackedCorpus() = default;
+
+    // Not copyable; the mapping belongs to this.
+    PackedCorpus(const PackedCorpus& from) = delete;
+    PackedCorpus& operator=(const PackedCorpus& from) = delete;
+
+    ~PackedCorpus() {
+        close();
+    }
+
+    // Whether the file starts like a packed corpus, so callers can tell one from text.
+    static bool isPacked(const std::string& fn) {
+        char start[4] = {};
+        FILE* file = fopen(fn.c_str(), "rb");
+        if (file == nullptr) return false;
+        bool packed = fread(start, 1, 4, file) == 4 && memcmp(start, PackedFormat::MAGIC, 4) == 0;
+        fclose(file);
+        return packed;
+    }
+
+    // Map the file and check its header and length.  The hash isn't checked; see
+    // verify().
+    // Return value:
+    //    true - OK
+    //    false - it couldn't be read or isn't a packed corpus; error() says why
+    bool open(const std::string& fn) {
+        close();
+        int fd = ::open(fn.c_str(), O_RDONLY);
+        struct stat info;
+        if (fd < 0 || fstat(fd, &info) != 0) {
+            if (fd >= 0) ::close(fd);
+            return fail("failed to open file");
+        }
+        mappingSize = size_t(info.st_size);
+        if (mappingSize < PackedFormat::HEADER_BYTES) {
+            ::close(fd);
+            return fail("too short to be a packed corpus");
+        }
+        void* addr = mmap(nullptr, mappingSize, PROT_READ, MAP_PRIVATE, fd, 0);
+        ::close(fd);
+        if (addr == MAP_FAILED) {
+            mappingSize = 0;
+            return fail("failed to map file");
+        }
+        madvise(addr, mappingSize, MADV_SEQUENTIAL);
+        mapping = static_cast<const uint8_t*>(addr);
+
+        using namespace PackedFormat;
+        if (memcmp(mapping, MAGIC, 4) != 0) return fail("not a packed corpus");
+        if (getLE(mapping + 4, 2) != VERSION) return fail("unknown packed corpus version");
+        size = mapping[6];
+        bits = mapping[7];
+        withSolutions = (mapping[8] & HAS_SOLUTIONS) != 0;
+        count = getLE(mapping + 16, 8);
+        hash = getLE(mapping + 24, 8);
+        if (size < 1 || bits != bitsPerValue(size)) return fail("bad grid size in header");
+        puzzleBytes = gridBytes(size, bits);
+        if ((mappingSize - HEADER_BYTES) / recordBytes() != count || (mappingSize - HEADER_BYTES) % recordBytes() != 0) {
+            return fail("length doesn't match the number of puzzles");
+        }
+        return true;
+    }
+
+    // Check the hash of the puzzles against the header's.
+    bool verify() const {
+        if (mapping == nullptr) return false;
+        return PackedFormat::hashBytes(PackedFormat::HASH_START, mapping + PackedFormat::HEADER_BYTES,
+                                       mappingSize - PackedFormat::HEADER_BYTES) == hash;
+    }
+
+    // Why open() failed.
+    const char* error() const {
+        return problem;
+    }
+
+    // The grid size (rows), the number of puzzles, and whether solutions are stored.
+    int gridSize() const {
+        return size;
+    }
+    size_t puzzleCount() const {
+        return count;
+    }
+    bool hasSolutions() const {
+        return withSolutions;
+    }
+
+    // The bytes each puzzle takes, with its solution if there is one.
+    size_t recordBytes() const {
+        return withSolutions ? 2 * puzzleBytes : puzzleBytes;
+    }
+
+    // Unpack puzzle idx into cells (gridSize() squared values, row by row, zero for
+    // blank) and, if there are solutions and solution isn't null, its solution.
+    void get(const size_t idx, uint8_t* cells, uint8_t* solution = nullptr) const {
+        const uint8_t* record = mapping + PackedFormat::HEADER_BYTES + idx * recordBytes();
+        PackedFormat::unpackGrid(record, size * size, bits, cells);
+        if (solution != nullptr && withSolutions) {
+            PackedFormat::unpackGrid(record + puzzleBytes, size * size, bits, solution);
+        }
+    }
+
+    // Unpack the next puzzle, as get().
+    // Return value:
+    //    true - cells (and solution) are the next puzzle
+    //    false - there are no more
+    bool next(uint8_t* cells, uint8_t* solution = nullptr) {
+        if (position >= count) return false;
+        get(position++, cells, solution);
+        return true;
+    }
+
+private:
+    const uint8_t* mapping = nullptr;
+    size_t mappingSize = 0;
+    const char* problem = "";
+    int size = 0;
+    int bits = 0;
+    bool withSolutions = false;
+    size_t count = 0;
+    uint64_t hash = 0;
+    size_t puzzleBytes = 0;
+    size_t position = 0;
+
+    bool fail(const char* why) {
+        close();
+        problem = why;
+        return false;
+    }
+
+    void close() {
+        if (mapping != nullptr) {
+            munmap(const_cast<uint8_t*>(mapping), mappingSize);
+        }
+        mapping = nullptr;
+        mappingSize = 0;
+        count = position = 0;
+    }
+};
+
+// Writes a packed corpus.  The header is written last, once the count and hash are
+// known.
+class PackedCorpusWriter {
+
+public:
+
+    PackedCorpusWriter() = default;
+
+    PackedCorpusWriter(const PackedCorpusWriter& from) = delete;
+    PackedCorpusWriter& operator=(const PackedCorpusWriter& from) = delete;
+
+    ~PackedCorpusWriter() {
+        if (file != nullptr) fclose(file);
+    }
+
+    // Start a file of size x size puzzles, with or without solutions.
+    // Return value:
+    //    true - OK
+    //    false - the file couldn't be created, or the size is out of range
+    bool open(const std::string& fn, const int gridSize, const bool solutions) {
+        if (gridSize < 1 || gridSize > MAX_SIZE) return false;
+        file = fopen(fn.c_str(), "wb");
+        if (file == nullptr) return false;
+        size = gridSize;
+        bits = PackedFormat::bitsPerValue(size);
+        withSolutions = solutions;
+        count = 0;
+        hash = PackedFormat::HASH_START;
+        uint8_t header[PackedFormat::HEADER_BYTES] = {};
+        return fwrite(header, 1, sizeof(header), file) == sizeof(header);
+    }
+
+    // Add a puzzle (size squared values, row by row, zero for blank), and its
+    // solution if the file has solutions; null for a puzzle without one.
+    // Return value:
+    //    true - OK
+    //    false - the file isn't open, a value is over size (so it wouldn't read back
+    //            as it was), or it couldn't be written; nothing is added for the
+    //            first two
+    bool add(const uint8_t* cells, const uint8_t* solution = nullptr) {
+        if (file == nullptr) return false;
+        const int numSpots = size * size;
+        for (int idx=0; idx < numSpots; idx++) {
+            if (cells[idx] > size) return false;
+            if (withSolutions && solution != nullptr && solution[idx] > size) return false;
+        }
+        const size_t bytes = PackedFormat::gridBytes(size, bits);
+        uint8_t record[2 * MAX_SIZE * MAX_SIZE];
+        PackedFormat::packGrid(cells, size * size, bits, record);
+        size_t length = bytes;
+        if (withSolutions) {
+            if (solution != nullptr) PackedFormat::packGrid(solution, size * size, bits, record + bytes);
+            else memset(record + bytes, 0, bytes);
+            length += bytes;
+        }
+        hash = PackedFormat::hashBytes(hash, record, length);
+        count++;
+        return fwrite(record, 1, length, file) == length;
+    }
+
+    // Write the header and close the file.
+    // Return value:
+    //    true - everything was written
+    //    false - something failed
+    bool close() {
+        if (file == nullptr) return false;
+        using namespace PackedFormat;
+        uint8_t header[HEADER_BYTES] = {};
+        memcpy(header, MAGIC, 4);
+        putLE(header + 4, VERSION, 2);
+        header[6] = uint8_t(size);
+        header[7] = uint8_t(bits);
+        header[8] = withSolutions ? HAS_SOLUTIONS : 0;
+        putLE(header + 16, count, 8);
+        putLE(header + 24, hash, 8);
+        bool ok = fseek(file, 0, SEEK_SET) == 0 && fwrite(header, 1, sizeof(header), file) == sizeof(header);
+        ok = fclose(file) == 0 && ok;
+        file = nullptr;
+        return ok;
+    }
+
+    size_t puzzleCount() const {
+        return count;
+    }
+
+private:
+    static constexpr int MAX_SIZE = 64;
+
+    FILE* file = nullptr;
+    int size = 0;
+    int bits = 4;
+    bool withSolutions = false;
+    size_t count = 0;
+    uint64_t hash = 0;
+};
+
+#endif // PACKEDCORPUS_H
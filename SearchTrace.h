@@ -0,0 +1,324 @@
+//============================================================================
+// Name        : SearchTrace.h
+// Author      : Jeff Hancock
+//               https://www.linkedin.com/in/jeffreythancock/
+// Copyright   : Carte blanche.  Plagiarize at will.
+// Description : Records the search tree of BasicSudokuPuzzle::solve() to a
+//               file, one record per guess, for working out offline why some
+//               puzzles take so much longer than others.  See
+//               SudokuTraceSummary.cpp for making sense of the result.
+//============================================================================
+
+#ifndef SEARCHTRACE_H
+#define SEARCHTRACE_H
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+#include "SudokuPuzzle.h"
+
+// How a node of the search tree turned out.
+enum class TraceOutcome : uint8_t {
+    // A solution was reached at or below the node.
+    SOLVED,
+    // Setting the node's value led straight to a contradiction; nothing was tried below it.
+    DEAD_END,
+    // Guesses were tried below the node and none led to a solution.
+    EXHAUSTED,
+    // The search stopped (e.g. it had all the solutions it wanted) before the node was done.
+    UNFINISHED
+};
+
+inline const char* traceOutcomeName(const TraceOutcome outcome) {
+    switch (outcome) {
+    case TraceOutcome::SOLVED: return "solved";
+    case TraceOutcome::DEAD_END: return "dead_end";
+    case TraceOutcome::EXHAUSTED: return "exhausted";
+    default: return "unfinished";
+    }
+}
+
+// One node of a search tree: a guess, or for node 0 the puzzle as given.  The counts
+// are for the node itself, not counting the nodes below it; the times cover the
+// node and everything below it, in nanoseconds from the start of the tree.
+struct TraceRecord {
+    // Which tree (puzzle) of the trace this belongs to.
+    uint32_t tree = 0;
+    uint32_t node = 0;
+    // The node this guess was made from; the root is its own parent.
+    uint32_t parent = 0;
+    // The guess: value at row, col.  All zero for the root.
+    uint8_t row = 0;
+    uint8_t col = 0;
+    uint8_t value = 0;
+    TraceOutcome outcome = TraceOutcome::UNFINISHED;
+    // The number of guesses in effect, counting this one.
+    uint16_t depth = 0;
+    uint16_t reserved = 0;
+    // Possibilities removed, propagation passes run and forced values set.
+    uint32_t eliminated = 0;
+    uint32_t passes = 0;
+    uint32_t forced = 0;
+    uint64_t startNs = 0;
+    uint64_t endNs = 0;
+};
+static_assert(sizeof(TraceRecord) == 48, "trace records are written as they are");
+
+enum class TraceFormat {
+    // A 16 byte header ("SDKT", version, record size) and then TraceRecords as they
+    // are in memory.
+    BINARY,
+    // One JSON object per record, per line.
+    JSON_LINES
+};
+
+// Writes the search trees of any number of puzzles to a file.  For each puzzle, call
+// beginTree() before solving and endTree() after; in between, a puzzle built with
+// RecordTrace as its Tracer on the same thread records each guess here.  Records are
+// written as nodes finish, so children come before their parents.  Only one tree can
+// be open per thread at a time, and solveParallel() isn't traced.  Only PROPAGATION
+// reports reaching a solution, so with DANCING_LINKS the nodes on the way to one
+// come out as UNFINISHED.
+class SearchTraceWriter {
+
+public:
+
+    static constexpr uint16_t VERSION = 1;
+
+    SearchTraceWriter() = default;
+
+    SearchTraceWriter(const SearchTraceWriter& from) = delete;
+    SearchTraceWriter& operator=(const SearchTraceWriter& from) = delete;
+
+    ~SearchTraceWriter() {
+        close();
+    }
+
+    // Create the file.
+    // Return value:
+    //    true - OK
+    //    false - it couldn't be created
+    bool open(const std::string& fn, const TraceFormat traceFormat = TraceFormat::BINARY) {
+        close();
+        file = fopen(fn.c_str(), "wb");
+        if (file == nullptr) return false;
+        format = traceFormat;
+        if (format == TraceFormat::BINARY) {
+            uint8_t header[16] = { 'S', 'D', 'K', 'T', uint8_t(VERSION), uint8_t(VERSION >> 8),
+                                   uint8_t(sizeof(TraceRecord)), 0 };
+            fwrite(header, 1, sizeof(header), file);
+        }
+        return true;
+    }
+
+    // Flush and close the file.
+    // Return value:
+    //    true - everything was written
+    //    false - something failed
+    bool close() {
+        if (file == nullptr) return true;
+        bool ok = !ferror(file);
+        ok = fclose(file) == 0 && ok;
+        file = nullptr;
+        return ok;
+    }
+
+    // Start recording a tree on this thread.  stats is the puzzle's getStats(), which
+    // stays put while it solves, so the counts can be read as the search goes.
+    void beginTree(const SolverStats& stats) {
+        puzzleStats = &stats;
+        lastEliminated = 0;
+        lastPasses = 0;
+        nextNode = 1;
+        path.clear();
+        path.push_back(OpenNode());
+        path.back().record.tree = treeCount;
+        start = std::chrono::steady_clock::now();
+        active() = this;
+    }
+
+    // Finish the tree begun on this thread: whatever is still open is written out.
+    void endTree() {
+        checkpoint();
+        while (!path.empty()) closeNode(false);
+        treeCount++;
+        active() = nullptr;
+    }
+
+    // The writer recording on this thread, if any.
+    static SearchTraceWriter*& active() {
+        static thread_local SearchTraceWriter* writer = nullptr;
+        return writer;
+    }
+
+    // The RecordTrace hooks.
+
+    void tryingValue(const int row, const int col, const int value, const int depth) {
+        checkpoint();
+        path.back().hasChildren = true;
+        OpenNode node;
+        node.record.tree = treeCount;
+        node.record.node = nextNode++;
+        node.record.parent = path.back().record.node;
+        node.record.row = uint8_t(row);
+        node.record.col = uint8_t(col);
+        node.record.value = uint8_t(value);
+        node.record.depth = uint16_t(depth);
+        node.record.startNs = nanosSinceStart();
+        path.push_back(node);
+    }
+
+    void backtracking() {
+        checkpoint();
+        if (path.size() > 1) closeNode(true);
+    }
+
+    void forcedValue() {
+        path.back().record.forced++;
+    }
+
+    void propagated(const int blanksLeft) {
+        if (blanksLeft == 0) path.back().solutions++;
+    }
+
+private:
+    struct OpenNode {
+        TraceRecord record;
+        bool hasChildren = false;
+        // Solutions reached at or below the node so far.
+        long solutions = 0;
+    };
+
+    FILE* file = nullptr;
+    TraceFormat format = TraceFormat::BINARY;
+    const SolverStats* puzzleStats = nullptr;
+    long lastEliminated = 0;
+    long lastPasses = 0;
+    uint32_t treeCount = 0;
+    uint32_t nextNode = 1;
+    // The root, then each guess in effect, innermost last.
+    std::vector<OpenNode> path;
+    std::chrono::steady_clock::time_point start;
+
+    uint64_t nanosSinceStart() const {
+        return uint64_t(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count());
+    }
+
+    // Put the work counted since the last checkpoint down to the innermost open node.
+    void checkpoint() {
+        if (puzzleStats == nullptr || path.empty()) return;
+        // solve() starts its counts again from zero.
+        if (puzzleStats->candidatesEliminated < lastEliminated) lastEliminated = 0;
+        if (puzzleStats->propagationPasses < lastPasses) lastPasses = 0;
+        path.back().record.eliminated += uint32_t(puzzleStats->candidatesEliminated - lastEliminated);
+        path.back().record.passes += uint32_t(puzzleStats->propagationPasses - lastPasses);
+        lastEliminated = puzzleStats->candidatesEliminated;
+        lastPasses = puzzleStats->propagationPasses;
+    }
+
+    // Write out the innermost open node and hand its solutions on to its parent.
+    // finished is whether the search is done with it, as opposed to having stopped.
+    void closeNode(const bool finished) {
+        OpenNode node = path.back();
+        path.pop_back();
+        TraceRecord& record = node.record;
+        record.endNs = nanosSinceStart();
+        if (node.solutions > 0) record.outcome = TraceOutcome::SOLVED;
+        else if (!finished && !path.empty()) record.outcome = TraceOutcome::UNFINISHED;
+        else record.outcome = node.hasChildren ? TraceOutcome::EXHAUSTED : TraceOutcome::DEAD_END;
+        if (!path.empty()) path.back().solutions += node.solutions;
+        write(record);
+    }
+
+    void write(const TraceRecord& record) {
+        if (file == nullptr) return;
+        if (format == TraceFormat::BINARY) {
+            fwrite(&record, sizeof(record), 1, file);
+            return;
+        }
+        fprintf(file, "{\"tree\":%u,\"node\":%u,\"parent\":%u,\"row\":%u,\"col\":%u,\"value\":%u,\"depth\":%u,"
+                "\"eliminated\":%u,\"passes\":%u,\"forced\":%u,\"outcome\":\"%s\",\"start_ns\":%llu,\"end_ns\":%llu}\n",
+                record.tree, record.node, record.parent, unsigned(record.row), unsigned(record.col),
+                unsigned(record.value), unsigned(record.depth), record.eliminated, record.passes, record.forced,
+                traceOutcomeName(record.outcome), (unsigned long long)record.startNs, (unsigned long long)record.endNs);
+    }
+};
+
+// A Tracer (see NoTrace) that records the search to the SearchTraceWriter active on
+// this thread, if there is one.
+struct RecordTrace {
+    template <typename Puzzle>
+    static void guessing(const Puzzle&, const int /*row*/, const int /*col*/, const int /*count*/) {}
+    static void tryingValue(const int row, const int col, const int value, const int depth) {
+        if (SearchTraceWriter* writer = SearchTraceWriter::active()) writer->tryingValue(row, col, value, depth);
+    }
+    static void backtracking(const int /*row*/, const int /*col*/, const int /*value*/) {
+        if (SearchTraceWriter* writer = SearchTraceWriter::active()) writer->backtracking();
+    }
+    static void forcedValue(const int /*row*/, const int /*col*/, const int /*value*/) {
+        if (SearchTraceWriter* writer = SearchTraceWriter::active()) writer->forcedValue();
+    }
+    static void contradiction() {}
+    static void propagated(const int blanksLeft) {
+        if (SearchTraceWriter* writer = SearchTraceWriter::active()) writer->propagated(blanksLeft);
+    }
+    static void ruleApplied(const char* /*name*/, const int /*rc*/) {}
+};
+
+// Read every record of a trace file in either format.
+// Return value:
+//    true - records holds them all
+//    false - the file couldn't be read or isn't a trace
+inline bool readSearchTrace(const std::string& fn, std::vector<TraceRecord>& records) {
+    FILE* file = fopen(fn.c_str(), "rb");
+    if (file == nullptr) return false;
+    records.clear();
+    uint8_t header[16];
+    size_t got = fread(header, 1, sizeof(header), file);
+    bool ok = true;
+    if (got == sizeof(header) && memcmp(header, "SDKT", 4) == 0) {
+        if (header[6] != sizeof(TraceRecord)) {
+            ok = false;
+        }
+        TraceRecord record;
+        while (ok && fread(&record, sizeof(record), 1, file) == 1) {
+            records.push_back(record);
+        }
+    }
+    else {
+        // JSON lines, as written by SearchTraceWriter; the fields are always in order.
+        rewind(file);
+        char line[512];
+        while (fgets(line, sizeof(line), file) != nullptr) {
+            TraceRecord record;
+            unsigned row, col, value, depth;
+            char outcome[16];
+            unsigned long long startNs, endNs;
+            if (sscanf(line, "{\"tree\":%u,\"node\":%u,\"parent\":%u,\"row\":%u,\"col\":%u,\"value\":%u,\"depth\":%u,"
+                       "\"eliminated\":%u,\"passes\":%u,\"forced\":%u,\"outcome\":\"%15[a-z_]\",\"start_ns\":%llu,\"end_ns\":%llu}",
+                       &record.tree, &record.node, &record.parent, &row, &col, &value, &depth, &record.eliminated,
+                       &record.passes, &record.forced, outcome, &startNs, &endNs) != 13) {
+                ok = false;
+                break;
+            }
+            record.row = uint8_t(row);
+            record.col = uint8_t(col);
+            record.value = uint8_t(value);
+            record.depth = uint16_t(depth);
+            record.startNs = startNs;
+            record.endNs = endNs;
+            for (TraceOutcome candidate : { TraceOutcome::SOLVED, TraceOutcome::DEAD_END, TraceOutcome::EXHAUSTED,
+                                            TraceOutcome::UNFINISHED }) {
+                if (strcmp(outcome, traceOutcomeName(candidate)) == 0) record.outcome = candidate;
+            }
+            records.push_back(record);
+        }
+    }
+    fclose(file);
+    return ok;
+}
+
+#endif // SEARCHTRACE_H
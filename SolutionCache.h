@@ -0,0 +1,414 @@
+//============================================================================
+// Name        : SolutionCache.h
+// Author      : Jeff Hancock
+//               https://www.linkedin.com/in/jeffreythancock/
+// Copyright   : Carte blanche.  Plagiarize at will.
+// Description : A cache of solved 9x9 puzzles keyed by canonical form, so that
+//               a puzzle that is just a relabelling, reshuffling or
+//               transposition of one already solved isn't solved again.
+//============================================================================
+
+#ifndef SOLUTIONCACHE_H
+#define SOLUTIONCACHE_H
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <list>
+#include <mutex>
+#include <unordered_map>
+#include <utility>
+#include "SudokuPuzzle.h"
+
+// How a 9x9 grid maps onto its canonical form: canonical spot (row, col) holds
+// labels[v], where v is the value at (rows[row], cols[col]) of the grid, or of its
+// transpose if transpose is set.  labels[0] is always 0, so blanks stay blank.
+struct GridTransform {
+    bool transpose = false;
+    uint8_t rows[9];
+    uint8_t cols[9];
+    uint8_t labels[10];
+};
+
+// The orders of the nine rows (or columns) that keep each band (or stack) together:
+// the bands in any order, and the rows within each band in any order.  6 x 6^3 of them.
+struct LineOrders {
+    static constexpr int COUNT = 1296;
+    uint8_t orders[COUNT][9];
+
+    LineOrders() {
+        static const uint8_t PERMS[6][3] = { {0,1,2}, {0,2,1}, {1,0,2}, {1,2,0}, {2,0,1}, {2,1,0} };
+        int idx = 0;
+        for (int bands=0; bands < 6; bands++) {
+            for (int first=0; first < 6; first++) {
+                for (int second=0; second < 6; second++) {
+                    for (int third=0; third < 6; third++) {
+                        const int within[3] = { first, second, third };
+                        for (int slot=0; slot < 9; slot++) {
+                            orders[idx][slot] = uint8_t(3 * PERMS[bands][slot / 3] + PERMS[within[slot / 3]][slot % 3]);
+                        }
+                        idx++;
+                    }
+                }
+            }
+        }
+    }
+};
+
+// Finds the canonical form of a 9x9 puzzle.  Each row gets a key that depends only on
+// where its givens are relative to the rest of the puzzle (how many it has, and how
+// many givens share a column with each), and so does each column, band and stack.
+// Of the grids that can be made from the puzzle by relabelling the values, reordering
+// the bands, the stacks and the rows and columns within them, and transposing, only
+// those with the bands, rows within bands, stacks and columns within stacks in key
+// order are considered, and the canonical form is the least of those read row by row,
+// with blanks lowest and values labelled in order of first appearance.  The keys
+// don't change when the puzzle is reshuffled, so two puzzles have the same canonical
+// form exactly when one can be turned into the other.
+//
+// Every column order allowed by the keys (and transposition) is tried, and for each
+// the rows are chosen one at a time, dropping any choice that makes a row greater than
+// the same row of the best grid so far.  Puzzles with a lot of symmetry leave many
+// orders to try, so the search gives up after NODE_LIMIT rows.  Puzzles of 17 givens
+// or more take a few hundred at most; an empty grid would take around 200000 (15ms),
+// and any grid with fewer than 17 givens has more than one solution, so those aren't
+// tried at all.
+class Canonicalizer {
+
+public:
+    static constexpr long NODE_LIMIT = 5000;
+    static constexpr int MIN_GIVENS = 17;
+
+    // Set canonical to the canonical form of cells (both row by row, zero for blank,
+    // values 0 - 9) and transform to a way of getting there.
+    // Return value:
+    //    true - done
+    //    false - there are fewer than MIN_GIVENS givens, or the search took too long;
+    //            canonical and transform are unset
+    bool canonicalize(const uint8_t (&cells)[81], uint8_t (&canonical)[81], GridTransform& transform) {
+        int givens = 0;
+        for (uint8_t value : cells) givens += value != 0;
+        if (givens < MIN_GIVENS) return false;
+        memset(best, 0xFF, sizeof(best));
+        nodes = 0;
+        for (int flip=0; flip < 2; flip++) {
+            for (int row=0; row < 9; row++) {
+                for (int col=0; col < 9; col++) {
+                    grid[row][col] = flip ? cells[9 * col + row] : cells[9 * row + col];
+                }
+            }
+            computeKeys();
+            current.transpose = flip != 0;
+            for (int idx=0; idx < LineOrders::COUNT; idx++) {
+                cols = ORDERS.orders[idx];
+                if (!inKeyOrder(cols, colKeys, stackKeys)) continue;
+                uint8_t labels[10] = {};
+                chooseRow(0, 0, labels, 1);
+                if (nodes > NODE_LIMIT) return false;
+            }
+        }
+        memcpy(canonical, best, sizeof(canonical));
+        transform = bestTransform;
+        memcpy(transform.cols, bestCols, sizeof(transform.cols));
+        // Values that aren't in the puzzle get the unused labels, in order, so the
+        // transform is a complete relabelling.
+        uint8_t next = 1;
+        for (int value=1; value <= 9; value++) {
+            if (transform.labels[value] != 0) next = std::max(next, uint8_t(transform.labels[value] + 1));
+        }
+        for (int value=1; value <= 9; value++) {
+            if (transform.labels[value] == 0) transform.labels[value] = next++;
+        }
+        return true;
+    }
+
+private:
+    static inline const LineOrders ORDERS{};
+
+    uint8_t grid[9][9];
+    // The keys of the rows and columns of grid, and of its bands and stacks.
+    uint64_t rowKeys[9];
+    uint64_t colKeys[9];
+    uint64_t bandKeys[3];
+    uint64_t stackKeys[3];
+    const uint8_t* cols = nullptr;
+    uint8_t best[81];
+    GridTransform current;
+    GridTransform bestTransform;
+    uint8_t bestCols[9];
+    long nodes = 0;
+
+    // Mix a value into a key.  Any function would do, as long as different inputs
+    // rarely give the same key; equal keys just leave more orders to try.
+    static uint64_t mix(const uint64_t key, const uint64_t value) {
+        return (key ^ value) * 0x100000001B3ull + (key >> 29);
+    }
+
+    // A key for three lines from their own keys, whatever order they are in.
+    static uint64_t groupKey(const uint64_t* keys) {
+        uint64_t sorted[3] = { keys[0], keys[1], keys[2] };
+        std::sort(sorted, sorted + 3);
+        return mix(mix(mix(7, sorted[0]), sorted[1]), sorted[2]);
+    }
+
+    // Work out the keys for grid.  A row's key is made from its number of givens and
+    // the sorted numbers of givens in the columns of its givens; likewise for columns.
+    void computeKeys() {
+        int rowCounts[9] = {}, colCounts[9] = {};
+        for (int row=0; row < 9; row++) {
+            for (int col=0; col < 9; col++) {
+                if (grid[row][col] != 0) {
+                    rowCounts[row]++;
+                    colCounts[col]++;
+                }
+            }
+        }
+        for (int line=0; line < 9; line++) {
+            // One more than the count for each given, zero for each blank, so that
+            // sorted they say the same whatever order the line is in.
+            int acrossRow[9], acrossCol[9];
+            for (int other=0; other < 9; other++) {
+                acrossRow[other] = grid[line][other] != 0 ? colCounts[other] + 1 : 0;
+                acrossCol[other] = grid[other][line] != 0 ? rowCounts[other] + 1 : 0;
+            }
+            std::sort(acrossRow, acrossRow + 9);
+            std::sort(acrossCol, acrossCol + 9);
+            rowKeys[line] = colKeys[line] = 0;
+            for (int idx=0; idx < 9; idx++) {
+                rowKeys[line] = mix(rowKeys[line], uint64_t(acrossRow[idx]));
+                colKeys[line] = mix(colKeys[line], uint64_t(acrossCol[idx]));
+            }
+        }
+        for (int group=0; group < 3; group++) {
+            bandKeys[group] = groupKey(&rowKeys[3 * group]);
+            stackKeys[group] = groupKey(&colKeys[3 * group]);
+        }
+    }
+
+    // Whether a row or column order puts the groups, and the lines within each group,
+    // in key order.
+    static bool inKeyOrder(const uint8_t* order, const uint64_t (&lineKeys)[9], const uint64_t (&groupKeys)[3]) {
+        for (int slot=1; slot < 9; slot++) {
+            if (slot % 3 == 0) {
+                if (groupKeys[order[slot] / 3] < groupKeys[order[slot - 3] / 3]) return false;
+            }
+            else if (lineKeys[order[slot]] < lineKeys[order[slot - 1]]) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // Choose the grid row for canonical row slot, given the bands already used (a
+    // bit each) and the labels given out so far.  Only rows that keep the order
+    // inKeyOrder() wants for columns are tried.  A row is only kept if it is no greater than
+    // best's row slot; a smaller one replaces it and everything after.
+    void chooseRow(const int slot, const unsigned usedBands, const uint8_t (&labels)[10], const uint8_t nextLabel) {
+        if (slot == 9) {
+            bestTransform = current;
+            memcpy(bestTransform.labels, labels, sizeof(labels));
+            memcpy(bestCols, cols, sizeof(bestCols));
+            return;
+        }
+        if (++nodes > NODE_LIMIT) return;
+        // The rows that may go here: those of the lowest keyed bands not yet used, or
+        // the lowest keyed rows not yet used in the current band.  Taking the lowest
+        // each time means there is always a row for the next slot.
+        bool allowed[9] = {};
+        uint64_t lowest = UINT64_MAX;
+        if (slot % 3 == 0) {
+            for (int band=0; band < 3; band++) {
+                if ((usedBands >> band & 1) == 0) lowest = std::min(lowest, bandKeys[band]);
+            }
+            for (int row=0; row < 9; row++) {
+                allowed[row] = (usedBands >> (row / 3) & 1) == 0 && bandKeys[row / 3] == lowest;
+            }
+        }
+        else {
+            const int band = current.rows[slot - 1] / 3;
+            bool unused[9] = {};
+            for (int row = 3 * band; row < 3 * band + 3; row++) {
+                unused[row] = row != current.rows[slot - 1] && (slot % 3 == 1 || row != current.rows[slot - 2]);
+                if (unused[row]) lowest = std::min(lowest, rowKeys[row]);
+            }
+            for (int row = 3 * band; row < 3 * band + 3; row++) {
+                allowed[row] = unused[row] && rowKeys[row] == lowest;
+            }
+        }
+        uint8_t* bestRow = &best[9 * slot];
+        for (int row=0; row < 9; row++) {
+            if (!allowed[row]) continue;
+            const int band = row / 3;
+
+            uint8_t rowLabels[10];
+            memcpy(rowLabels, labels, sizeof(rowLabels));
+            uint8_t next = nextLabel;
+            uint8_t values[9];
+            // -1 once greater than best's row, 1 once smaller, 0 while equal.
+            int order = 0;
+            for (int col=0; col < 9; col++) {
+                uint8_t value = grid[row][cols[col]];
+                if (value != 0 && rowLabels[value] == 0) rowLabels[value] = next++;
+                values[col] = rowLabels[value];
+                if (order == 0 && values[col] != bestRow[col]) {
+                    order = values[col] < bestRow[col] ? 1 : -1;
+                    if (order < 0) break;
+                }
+            }
+            if (order < 0) continue;
+            if (order > 0) {
+                memcpy(bestRow, values, 9);
+                memset(bestRow + 9, 0xFF, 81 - 9 * (slot + 1));
+            }
+            current.rows[slot] = uint8_t(row);
+            chooseRow(slot + 1, usedBands | (1u << band), rowLabels, next);
+        }
+    }
+};
+
+// Undo a transform: set cells to the grid whose canonical form (through transform) is
+// canonical.  Used to turn the solution of a canonical puzzle into the solution of
+// the puzzle it came from.
+inline void applyInverse(const GridTransform& transform, const uint8_t (&canonical)[81], uint8_t (&cells)[81]) {
+    uint8_t values[10] = {};
+    for (int value=1; value <= 9; value++) {
+        values[transform.labels[value]] = uint8_t(value);
+    }
+    for (int row=0; row < 9; row++) {
+        for (int col=0; col < 9; col++) {
+            int gridRow = transform.rows[row], gridCol = transform.cols[col];
+            if (transform.transpose) std::swap(gridRow, gridCol);
+            cells[9 * gridRow + gridCol] = values[canonical[9 * row + col]];
+        }
+    }
+}
+
+// A bounded, thread-safe cache of solutions in front of SudokuPuzzle::solveInto(),
+// keyed by canonical form.  The least recently used entry goes when it is full.  The
+// entries are split between shards, each with its own lock, so that threads rarely
+// wait on each other.  Only puzzles with one solution are sure to get the same
+// solution as solving directly; for others, it is a solution.
+class SolutionCache {
+
+public:
+
+    // Hold up to capacity solutions (at least one per shard).
+    explicit SolutionCache(const size_t capacity) {
+        shardCapacity = std::max<size_t>(1, capacity / NUM_SHARDS);
+    }
+
+    // Not copyable or movable; the shards hold locks.
+    SolutionCache(const SolutionCache& from) = delete;
+    SolutionCache& operator=(const SolutionCache& from) = delete;
+
+    // Solve cells (row by row, zero for blank) as SudokuPuzzle::solveInto() would,
+    // looking in the cache first.  Puzzles found to be unsolvable are remembered too.
+    // Return value: see SolveStatus.  solution is only written when SOLVED.
+    SolveStatus solve(const uint8_t (&cells)[81], uint8_t (&solution)[81],
+                      const SolverBackend backend = SolverBackend::PROPAGATION) {
+        for (uint8_t value : cells) {
+            if (value > 9) return SolveStatus::INVALID;
+        }
+        thread_local Canonicalizer canonicalizer;
+        uint8_t canonical[81];
+        GridTransform transform;
+        if (!canonicalizer.canonicalize(cells, canonical, transform)) {
+            // Too sparse or too symmetric to be worth it; just solve it.
+            skipCount.fetch_add(1, std::memory_order_relaxed);
+            SudokuPuzzle sp(cells);
+            sp.setBackend(backend);
+            return sp.solveInto(solution);
+        }
+        Key key;
+        memcpy(key.data(), canonical, sizeof(canonical));
+        Shard& shard = shards[(KeyHash()(key) >> 32) % NUM_SHARDS];
+
+        Entry entry;
+        if (shard.find(key, entry)) {
+            hitCount.fetch_add(1, std::memory_order_relaxed);
+        }
+        else {
+            missCount.fetch_add(1, std::memory_order_relaxed);
+            SudokuPuzzle sp(canonical);
+            sp.setBackend(backend);
+            entry.status = sp.solveInto(entry.solution);
+            shard.add(key, entry, shardCapacity);
+        }
+        if (entry.status == SolveStatus::SOLVED) {
+            applyInverse(transform, entry.solution, solution);
+        }
+        return entry.status;
+    }
+
+    // How many solve() calls were answered from the cache, and how many weren't.
+    long hits() const {
+        return hitCount.load(std::memory_order_relaxed);
+    }
+    long misses() const {
+        return missCount.load(std::memory_order_relaxed);
+    }
+
+    // How many solve() calls were solved directly because the puzzle was too sparse or
+    // its canonical form took too long to find.
+    long skipped() const {
+        return skipCount.load(std::memory_order_relaxed);
+    }
+
+private:
+    static constexpr size_t NUM_SHARDS = 16;
+
+    struct Entry {
+        SolveStatus status;
+        uint8_t solution[81];
+    };
+
+    // The canonical form of a puzzle, which needs no allocating to look up.
+    typedef std::array<uint8_t, 81> Key;
+
+    struct KeyHash {
+        size_t operator()(const Key& key) const {
+            uint64_t hash = 0xCBF29CE484222325ull;
+            for (uint8_t value : key) hash = (hash ^ value) * 0x100000001B3ull;
+            return size_t(hash);
+        }
+    };
+
+    // Part of the cache, as a list of keys from most to least recently used and a map
+    // from key to entry and place in the list.
+    struct Shard {
+        std::mutex lock;
+        std::list<Key> recent;
+        std::unordered_map<Key, std::pair<Entry, std::list<Key>::iterator>, KeyHash> entries;
+
+        bool find(const Key& key, Entry& entry) {
+            std::lock_guard<std::mutex> guard(lock);
+            auto found = entries.find(key);
+            if (found == entries.end()) return false;
+            recent.splice(recent.begin(), recent, found->second.second);
+            entry = found->second.first;
+            return true;
+        }
+
+        void add(const Key& key, const Entry& entry, const size_t capacity) {
+            std::lock_guard<std::mutex> guard(lock);
+            // Another thread may have solved the same puzzle meanwhile.
+            if (entries.count(key) != 0) return;
+            if (entries.size() >= capacity) {
+                entries.erase(recent.back());
+                recent.pop_back();
+            }
+            recent.push_front(key);
+            entries.emplace(key, std::make_pair(entry, recent.begin()));
+        }
+    };
+
+    Shard shards[NUM_SHARDS];
+    size_t shardCapacity;
+    std::atomic<long> hitCount{0};
+    std::atomic<long> missCount{0};
+    std::atomic<long> skipCount{0};
+};
+
+#endif // SOLUTIONCACHE_H
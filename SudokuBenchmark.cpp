@@ -0,0 +1,690 @@
+//============================================================================
+// Name        : SudokuBenchmark.cpp
+// Author      : Jeff Hancock
+//               https://www.linkedin.com/in/jeffreythancock/
+// Copyright   : Carte blanche.  Plagiarize at will.
+// Description : Measures the solver over sets of puzzles (corpora), some read
+//               from the bundled files and some generated, and reports the
+//               results as JSON.  Can compare against an earlier run's JSON
+//               to flag regressions.
+//============================================================================
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <random>
+#include <chrono>
+#include <atomic>
+#include <cstdlib>
+#include <cstdint>
+#include <new>
+#include "SudokuPuzzle.h"
+#include "GridValidator.h"
+using namespace std;
+
+// Every heap allocation made by the program, so that the benchmark can report how
+// many solving takes.  The replacements are kept out of line so that the compiler
+// doesn't pair an inlined malloc() against the library's delete.
+atomic<long> allocationCount{0};
+
+[[gnu::noinline]] void* operator new(size_t size) {
+    allocationCount.fetch_add(1, memory_order_relaxed);
+    void* ptr = malloc(size != 0 ? size : 1);
+    if (ptr == nullptr) throw bad_alloc();
+    return ptr;
+}
+
+[[gnu::noinline]] void operator delete(void* ptr) noexcept {
+    free(ptr);
+}
+
+[[gnu::noinline]] void operator delete(void* ptr, size_t) noexcept {
+    free(ptr);
+}
+
+// One puzzle's values, row by row, 0 for a blank.
+struct Cells {
+    uint8_t values[SudokuPuzzle::NUM_SPOTS];
+};
+
+// A named set of puzzles to measure.
+struct Corpus {
+    string name;
+    vector<Cells> puzzles;
+};
+
+// The measurements for one corpus.
+struct CorpusResult {
+    string name;
+    size_t puzzles = 0;
+    size_t solved = 0;
+    double puzzlesPerSec = 0;
+    double p50Us = 0;
+    double p99Us = 0;
+    double maxUs = 0;
+    double guessesPerPuzzle = 0;
+    double allocationsPerPuzzle = 0;
+    // Each puzzle's fastest time, for comparing backends puzzle by puzzle.
+    vector<double> fastestUs;
+    // With more than one backend, the puzzles this one solved faster than the first.
+    long fasterThanFirst = -1;
+};
+
+// The measurements for one of the bulk validators.
+struct ValidatorResult {
+    string name;
+    size_t grids = 0;
+    size_t valid = 0;
+    double gridsPerSec = 0;
+};
+
+struct BenchmarkOptions {
+    // Extra corpora given on the command line, as name and file.
+    vector<pair<string, string>> corpusFiles;
+    // Where to find the bundled puzzle files.
+    string dataDir = ".";
+    // How many puzzles to generate for each of the generated corpora.
+    size_t generate = 200;
+    // How many completed grids to check with each bulk validator.
+    size_t validate = 100000;
+    // How many times to solve each corpus.
+    int repeat = 5;
+    unsigned seed = 1;
+    string outputFile;
+    string baselineFile;
+    // The backends to measure each corpus with.  Results for any but the first are
+    // named corpus/backend.
+    vector<SolverBackend> backends = { SolverBackend::PROPAGATION };
+    // Where the propagation backend guesses, and in what order.
+    SearchPolicy policy;
+    // How much worse (in percent) a measurement can be than the baseline before it
+    // counts as a regression.
+    double tolerance = 10;
+};
+
+// Add the puzzles from a file to corpus, skipping any that are malformed.
+// Return value:
+//    true - the file was read
+//    false - it couldn't be opened
+bool addPuzzles(Corpus& corpus, const string& fn) {
+    LineSource source;
+    if (!source.open(fn)) {
+        cerr << fn << ": failed to open file" << endl;
+        return false;
+    }
+    PuzzleReader<SudokuPuzzle::SIZE> reader(source);
+    Cells cells;
+    ParseError error;
+    while (reader.next(cells.values, error)) {
+        if (!error.ok()) {
+            cerr << fn << ": " << describe(error) << endl;
+            continue;
+        }
+        corpus.puzzles.push_back(cells);
+    }
+    return true;
+}
+
+// Check that the reader keeps each line of fn to itself: one record per line other
+// than comments, in order, malformed just where the line isn't a whole puzzle (81
+// characters).  CorpusMalformed.txt mixes truncated and overlong lines with good ones;
+// a short line once started a nine line puzzle and swallowed the eight after it.
+// Return value:
+//    true - every record was where it should be
+//    false - it wasn't, or the file couldn't be read
+bool checkReader(const string& fn) {
+    ifstream in(fn);
+    LineSource source;
+    if (!in || !source.open(fn)) {
+        cerr << fn << ": failed to open file" << endl;
+        return false;
+    }
+    PuzzleReader<SudokuPuzzle::SIZE> reader(source);
+    Cells cells;
+    ParseError error;
+    string text;
+    long lineNum = 0;
+    size_t numRecords = 0;
+    while (getline(in, text)) {
+        lineNum++;
+        if (text.empty() || text[0] == '#') continue;
+        bool good = text.size() == size_t(SudokuPuzzle::NUM_SPOTS);
+        if (!reader.next(cells.values, error) || error.ok() != good || reader.lineNumber() != lineNum) {
+            cerr << fn << ": line " << lineNum << " wasn't read as a " << (good ? "good" : "malformed") <<
+                    " record of its own" << endl;
+            return false;
+        }
+        numRecords++;
+    }
+    if (reader.next(cells.values, error)) {
+        cerr << fn << ": more records than the " << numRecords << " lines" << endl;
+        return false;
+    }
+    return true;
+}
+
+// A random solved grid: a simple pattern shuffled by relabelling the values,
+// reordering the bands, stacks and the rows and columns within them, and maybe
+// transposing.  Every one of those keeps a solved grid solved.
+Cells randomSolution(mt19937& rng) {
+    auto shuffled = [&rng](const int count) {
+        vector<int> order(count);
+        for (int idx=0; idx < count; idx++) order[idx] = idx;
+        shuffle(order.begin(), order.end(), rng);
+        return order;
+    };
+    vector<int> labels = shuffled(9);
+    vector<int> bands = shuffled(3), stacks = shuffled(3);
+    int rows[9], cols[9];
+    for (int band=0; band < 3; band++) {
+        vector<int> within = shuffled(3);
+        for (int idx=0; idx < 3; idx++) rows[3 * band + idx] = 3 * bands[band] + within[idx];
+    }
+    for (int stack=0; stack < 3; stack++) {
+        vector<int> within = shuffled(3);
+        for (int idx=0; idx < 3; idx++) cols[3 * stack + idx] = 3 * stacks[stack] + within[idx];
+    }
+    const bool transpose = (rng() & 1) != 0;
+
+    Cells cells;
+    for (int row=0; row < 9; row++) {
+        for (int col=0; col < 9; col++) {
+            int fromRow = rows[transpose ? col : row];
+            int fromCol = cols[transpose ? row : col];
+            int value = (3 * (fromRow % 3) + fromRow / 3 + fromCol) % 9;
+            cells.values[9 * row + col] = uint8_t(labels[value] + 1);
+        }
+    }
+    return cells;
+}
+
+// A random puzzle with a unique solution: starting from a solved grid, take out
+// values in random order as long as the solution stays unique, until only clues
+// are left or nothing more can be taken out.
+Cells randomPuzzle(mt19937& rng, const int clues) {
+    Cells cells = randomSolution(rng);
+    int order[81];
+    for (int idx=0; idx < 81; idx++) order[idx] = idx;
+    shuffle(order, order + 81, rng);
+    int remaining = 81;
+    for (int idx=0; idx < 81 && remaining > clues; idx++) {
+        uint8_t value = cells.values[order[idx]];
+        cells.values[order[idx]] = 0;
+        SudokuPuzzle sp(cells.values);
+        if (sp.countSolutions(2) == 1) {
+            remaining--;
+        }
+        else {
+            cells.values[order[idx]] = value;
+        }
+    }
+    return cells;
+}
+
+// The value at fraction (0 - 1) of the way through sorted values, by nearest rank.
+double percentile(const vector<double>& sorted, const double fraction) {
+    if (sorted.empty()) return 0;
+    size_t rank = size_t(fraction * double(sorted.size()) + 0.999999);
+    if (rank == 0) rank = 1;
+    return sorted[min(rank, sorted.size()) - 1];
+}
+
+const char* backendName(const SolverBackend backend) {
+    return backend == SolverBackend::DANCING_LINKS ? "dlx" : "propagation";
+}
+
+const char* branchRuleName(const BranchRule branch) {
+    switch (branch) {
+    case BranchRule::MOST_BLANK_PEERS: return "peers";
+    case BranchRule::FEWEST_PLACES_TIEBREAK: return "places-tiebreak";
+    case BranchRule::FEWEST_PLACES: return "places";
+    default: return "fewest";
+    }
+}
+
+const char* valueOrderName(const ValueOrder order) {
+    switch (order) {
+    case ValueOrder::LEAST_CONSTRAINING: return "lcv";
+    case ValueOrder::MOST_CONSTRAINING: return "mcv";
+    default: return "ascending";
+    }
+}
+
+// Solve (and check) every puzzle of the corpus repeat times with the given backend and
+// search policy, timing each one.
+CorpusResult measure(const Corpus& corpus, const int repeat, const SolverBackend backend, const SearchPolicy& policy) {
+    CorpusResult result;
+    result.name = corpus.name;
+    result.puzzles = corpus.puzzles.size();
+    result.fastestUs.assign(corpus.puzzles.size(), 0);
+    if (corpus.puzzles.empty()) {
+        return result;
+    }
+    // Build this thread's exact cover matrix now rather than in the first timed solve.
+    if (backend == SolverBackend::DANCING_LINKS) {
+        DancingLinks<3, 3>::forThisThread();
+    }
+
+    vector<double> latencies;
+    latencies.reserve(corpus.puzzles.size() * size_t(repeat));
+    long guesses = 0;
+    long allocations = 0;
+    double totalSeconds = 0;
+    for (int pass=0; pass < repeat; pass++) {
+        for (size_t idx=0; idx < corpus.puzzles.size(); idx++) {
+            const Cells& cells = corpus.puzzles[idx];
+            long allocationsBefore = allocationCount.load(memory_order_relaxed);
+            auto start = chrono::steady_clock::now();
+            SudokuPuzzle sp(cells.values);
+            sp.setBackend(backend);
+            sp.setSearchPolicy(policy);
+            bool ok = sp.solve() && sp.isSolutionValid();
+            auto stop = chrono::steady_clock::now();
+            allocations += allocationCount.load(memory_order_relaxed) - allocationsBefore;
+
+            double seconds = chrono::duration<double>(stop - start).count();
+            totalSeconds += seconds;
+            latencies.push_back(seconds * 1e6);
+            if (pass == 0 || seconds * 1e6 < result.fastestUs[idx]) result.fastestUs[idx] = seconds * 1e6;
+            guesses += sp.getStats().guesses;
+            if (pass == 0 && ok) result.solved++;
+        }
+    }
+    sort(latencies.begin(), latencies.end());
+    double count = double(latencies.size());
+    result.puzzlesPerSec = totalSeconds > 0 ? count / totalSeconds : 0;
+    result.p50Us = percentile(latencies, 0.50);
+    result.p99Us = percentile(latencies, 0.99);
+    result.maxUs = latencies.back();
+    result.guessesPerPuzzle = double(guesses) / count;
+    result.allocationsPerPuzzle = double(allocations) / count;
+    return result;
+}
+
+// count completed grids for the bulk validators, back to back.  About a quarter of
+// them are spoiled, in one of the ways a solver bug might: two values in a row
+// swapped (so only the columns are wrong), one value changed to another, or a value
+// out of range.
+vector<uint8_t> randomGrids(mt19937& rng, const size_t count) {
+    vector<uint8_t> grids(count * GRID_BYTES);
+    for (size_t idx=0; idx < count; idx++) {
+        Cells cells = randomSolution(rng);
+        uint8_t* grid = &grids[idx * GRID_BYTES];
+        copy(cells.values, cells.values + GRID_BYTES, grid);
+        if (rng() % 4 != 0) continue;
+        const size_t spot = rng() % GRID_BYTES;
+        switch (rng() % 3) {
+        case 0:
+            swap(grid[spot], grid[spot - spot % 9 + (spot % 9 + 1 + rng() % 8) % 9]);
+            break;
+        case 1:
+            grid[spot] = uint8_t(1 + (grid[spot] + rng() % 8) % 9);
+            break;
+        default:
+            grid[spot] = (rng() & 1) != 0 ? 0 : uint8_t(10 + rng() % 246);
+            break;
+        }
+    }
+    return grids;
+}
+
+// Check all the grids repeat times with one kind of bulk validator, and compare its
+// verdicts with the scalar check's.
+// Return value:
+//    true - every verdict agreed
+//    false - at least one didn't
+bool measureValidator(const vector<uint8_t>& grids, const int repeat, const ValidatorKind kind,
+                      ValidatorResult& result) {
+    const size_t count = grids.size() / GRID_BYTES;
+    result.name = string("validate/") + validatorName(kind);
+    result.grids = count;
+    result.valid = 0;
+    vector<uint64_t> passed((count + 63) / 64);
+    double totalSeconds = 0;
+    for (int pass=0; pass < repeat; pass++) {
+        auto start = chrono::steady_clock::now();
+        validateGrids(grids.data(), count, passed.data(), kind);
+        auto stop = chrono::steady_clock::now();
+        totalSeconds += chrono::duration<double>(stop - start).count();
+    }
+    result.gridsPerSec = totalSeconds > 0 ? double(count) * repeat / totalSeconds : 0;
+
+    bool agreed = true;
+    for (size_t idx=0; idx < count; idx++) {
+        bool valid = (passed[idx / 64] >> (idx % 64) & 1) != 0;
+        if (valid) result.valid++;
+        if (valid != isGridValid(&grids[idx * GRID_BYTES])) agreed = false;
+    }
+    return agreed;
+}
+
+// Find "key": number within text, as written by writeJson().
+// Return value:
+//    true - found; value is set
+//    false - not found
+bool jsonNumber(const string& text, const string& key, double& value) {
+    size_t at = text.find("\"" + key + "\":");
+    if (at == string::npos) return false;
+    value = strtod(text.c_str() + at + key.size() + 3, nullptr);
+    return true;
+}
+
+// Compare results with those in a JSON file written by an earlier run, adding a
+// description of each measurement that is worse by more than tolerance percent to
+// regressions.  Corpora and validators missing from either side, or of a different
+// size, are skipped.
+// Return value:
+//    true - the baseline was read
+//    false - it couldn't be
+bool compareWithBaseline(const vector<CorpusResult>& results, const vector<ValidatorResult>& validators,
+                         const string& fn, const double tolerance, vector<string>& regressions) {
+    ifstream in(fn);
+    if (!in.good()) {
+        cerr << fn << ": failed to open file" << endl;
+        return false;
+    }
+    stringstream buffer;
+    buffer << in.rdbuf();
+    const string text = buffer.str();
+    const double slack = tolerance / 100;
+
+    for (const CorpusResult& result : results) {
+        size_t start = text.find("\"name\": \"" + result.name + "\"");
+        if (start == string::npos) continue;
+        string entry = text.substr(start, text.find('}', start) - start);
+        double puzzles;
+        if (jsonNumber(entry, "puzzles", puzzles) && size_t(puzzles) != result.puzzles) {
+            cerr << result.name << ": the baseline has " << size_t(puzzles) << " puzzles, not comparing" << endl;
+            continue;
+        }
+
+        // Each measurement, its value now, and whether bigger is better.
+        struct Check {
+            const char* key;
+            double now;
+            bool higherIsBetter;
+        };
+        const Check checks[] = {
+            { "puzzles_per_sec", result.puzzlesPerSec, true },
+            { "p50_us", result.p50Us, false },
+            { "p99_us", result.p99Us, false },
+            { "guesses_per_puzzle", result.guessesPerPuzzle, false },
+            { "allocations_per_puzzle", result.allocationsPerPuzzle, false },
+        };
+        for (const Check& check : checks) {
+            double before;
+            if (!jsonNumber(entry, check.key, before)) continue;
+            bool worse = check.higherIsBetter ? check.now < before * (1 - slack)
+                                              : check.now > before * (1 + slack) + 1e-9;
+            if (worse) {
+                ostringstream message;
+                message << result.name << " " << check.key << ": " << before << " -> " << check.now;
+                regressions.push_back(message.str());
+            }
+        }
+    }
+    for (const ValidatorResult& validator : validators) {
+        size_t start = text.find("\"name\": \"" + validator.name + "\"");
+        if (start == string::npos) continue;
+        string entry = text.substr(start, text.find('}', start) - start);
+        double grids, before;
+        if (!jsonNumber(entry, "grids", grids) || size_t(grids) != validator.grids) continue;
+        if (jsonNumber(entry, "grids_per_sec", before) && validator.gridsPerSec < before * (1 - slack)) {
+            ostringstream message;
+            message << validator.name << " grids_per_sec: " << before << " -> " << validator.gridsPerSec;
+            regressions.push_back(message.str());
+        }
+    }
+    return true;
+}
+
+// Escape a string for JSON.  Only quotes and backslashes can turn up in our names.
+string jsonString(const string& text) {
+    string quoted = "\"";
+    for (char c : text) {
+        if (c == '"' || c == '\\') quoted += '\\';
+        quoted += c;
+    }
+    return quoted + "\"";
+}
+
+void writeJson(ostream& out, const BenchmarkOptions& options, const vector<CorpusResult>& results,
+               const vector<ValidatorResult>& validators, const vector<string>* regressions) {
+    out << "{" << endl;
+    out << "  \"repeat\": " << options.repeat << "," << endl;
+    out << "  \"seed\": " << options.seed << "," << endl;
+    out << "  \"branch\": " << jsonString(branchRuleName(options.policy.branch)) << "," << endl;
+    out << "  \"order\": " << jsonString(valueOrderName(options.policy.order)) << "," << endl;
+    out << "  \"corpora\": [" << endl;
+    for (size_t idx=0; idx < results.size(); idx++) {
+        const CorpusResult& result = results[idx];
+        out << "    {\"name\": " << jsonString(result.name) <<
+            ", \"puzzles\": " << result.puzzles <<
+            ", \"solved\": " << result.solved <<
+            ", \"puzzles_per_sec\": " << result.puzzlesPerSec <<
+            ", \"p50_us\": " << result.p50Us <<
+            ", \"p99_us\": " << result.p99Us <<
+            ", \"max_us\": " << result.maxUs <<
+            ", \"guesses_per_puzzle\": " << result.guessesPerPuzzle <<
+            ", \"allocations_per_puzzle\": " << result.allocationsPerPuzzle;
+        if (result.fasterThanFirst >= 0) {
+            out << ", \"faster_than_" << backendName(options.backends[0]) << "\": " << result.fasterThanFirst;
+        }
+        out << "}" <<
+            (idx + 1 < results.size() ? "," : "") << endl;
+    }
+    out << "  ]," << endl;
+    out << "  \"validators\": [" << endl;
+    for (size_t idx=0; idx < validators.size(); idx++) {
+        const ValidatorResult& validator = validators[idx];
+        out << "    {\"name\": " << jsonString(validator.name) <<
+            ", \"grids\": " << validator.grids <<
+            ", \"valid\": " << validator.valid <<
+            ", \"grids_per_sec\": " << validator.gridsPerSec << "}" <<
+            (idx + 1 < validators.size() ? "," : "") << endl;
+    }
+    out << "  ]";
+    if (regressions != nullptr) {
+        out << "," << endl << "  \"regressions\": [";
+        for (size_t idx=0; idx < regressions->size(); idx++) {
+            out << (idx == 0 ? "" : ", ") << jsonString((*regressions)[idx]);
+        }
+        out << "]";
+    }
+    out << endl << "}" << endl;
+}
+
+void printUsage() {
+    cerr << "Usage: SudokuBenchmark [options]" << endl;
+    cerr << "Solve the bundled and generated corpora and write the measurements as JSON." << endl;
+    cerr << "  --corpus NAME=FILE   Also measure the puzzles in FILE (may be repeated)" << endl;
+    cerr << "  --data-dir DIR       Where the bundled puzzle files are (default: .)" << endl;
+    cerr << "  --generate N         Puzzles in each generated corpus, 0 for none (default: 200)" << endl;
+    cerr << "  --validate N         Grids for the bulk validators, 0 for none (default: 100000)" << endl;
+    cerr << "  --repeat N           Times to solve each corpus (default: 5)" << endl;
+    cerr << "  --seed N             Seed for the generated corpora (default: 1)" << endl;
+    cerr << "  --backend NAME       propagation (default), dlx, or both to compare them" << endl;
+    cerr << "  --branch NAME        Where to guess: fewest (default), peers, places-tiebreak or places" << endl;
+    cerr << "  --order NAME         Order to try guesses in: ascending (default), lcv or mcv" << endl;
+    cerr << "  --output FILE        Write the JSON to FILE instead of stdout" << endl;
+    cerr << "  --baseline FILE      Compare with an earlier run's JSON; exit 1 on a regression" << endl;
+    cerr << "  --tolerance PCT      How much worse than the baseline is allowed (default: 10)" << endl;
+}
+
+int main(int argc, char* argv[]) {
+    BenchmarkOptions options;
+    for (int arg=1; arg < argc; arg++) {
+        string opt = argv[arg];
+        bool hasValue = arg + 1 < argc;
+        if (opt == "--corpus" && hasValue) {
+            string spec = argv[++arg];
+            size_t equals = spec.find('=');
+            if (equals == string::npos) {
+                printUsage();
+                return 2;
+            }
+            options.corpusFiles.emplace_back(spec.substr(0, equals), spec.substr(equals + 1));
+        }
+        else if (opt == "--data-dir" && hasValue) options.dataDir = argv[++arg];
+        else if (opt == "--generate" && hasValue) options.generate = size_t(atol(argv[++arg]));
+        else if (opt == "--validate" && hasValue) options.validate = size_t(atol(argv[++arg]));
+        else if (opt == "--repeat" && hasValue) options.repeat = max(1, atoi(argv[++arg]));
+        else if (opt == "--seed" && hasValue) options.seed = unsigned(atol(argv[++arg]));
+        else if (opt == "--output" && hasValue) options.outputFile = argv[++arg];
+        else if (opt == "--baseline" && hasValue) options.baselineFile = argv[++arg];
+        else if (opt == "--tolerance" && hasValue) options.tolerance = atof(argv[++arg]);
+        else if (opt == "--backend" && hasValue) {
+            string name = argv[++arg];
+            if (name == "propagation") options.backends = { SolverBackend::PROPAGATION };
+            else if (name == "dlx") options.backends = { SolverBackend::DANCING_LINKS };
+            else if (name == "both") options.backends = { SolverBackend::PROPAGATION, SolverBackend::DANCING_LINKS };
+            else {
+                printUsage();
+                return 2;
+            }
+        }
+        else if (opt == "--branch" && hasValue) {
+            string name = argv[++arg];
+            bool found = false;
+            for (BranchRule branch : { BranchRule::FEWEST_POSSIBILITIES, BranchRule::MOST_BLANK_PEERS,
+                                       BranchRule::FEWEST_PLACES_TIEBREAK, BranchRule::FEWEST_PLACES }) {
+                if (name == branchRuleName(branch)) {
+                    options.policy.branch = branch;
+                    found = true;
+                }
+            }
+            if (!found) {
+                printUsage();
+                return 2;
+            }
+        }
+        else if (opt == "--order" && hasValue) {
+            string name = argv[++arg];
+            bool found = false;
+            for (ValueOrder order : { ValueOrder::ASCENDING, ValueOrder::LEAST_CONSTRAINING, ValueOrder::MOST_CONSTRAINING }) {
+                if (name == valueOrderName(order)) {
+                    options.policy.order = order;
+                    found = true;
+                }
+            }
+            if (!found) {
+                printUsage();
+                return 2;
+            }
+        }
+        else {
+            printUsage();
+            return 2;
+        }
+    }
+
+    vector<Corpus> corpora;
+    const string dir = options.dataDir + "/";
+    {
+        Corpus examples{ "examples", {} };
+        for (const char* fn : { "UnitedSudoku1.txt", "UnitedSudoku2.txt", "DavesHardPuzzle.txt" }) {
+            addPuzzles(examples, dir + fn);
+        }
+        corpora.push_back(examples);
+    }
+    if (options.generate > 0) {
+        mt19937 rng(options.seed);
+        Corpus easy{ "easy", {} }, hard{ "hard", {} };
+        for (size_t idx=0; idx < options.generate; idx++) {
+            easy.puzzles.push_back(randomPuzzle(rng, 36));
+        }
+        // Taking out every value that can be leaves a minimal puzzle, which usually
+        // needs some guessing.
+        for (size_t idx=0; idx < options.generate; idx++) {
+            hard.puzzles.push_back(randomPuzzle(rng, 0));
+        }
+        corpora.push_back(easy);
+        corpora.push_back(hard);
+    }
+    {
+        Corpus clue17{ "17-clue", {} };
+        addPuzzles(clue17, dir + "Corpus17Clue.txt");
+        corpora.push_back(clue17);
+        Corpus adversarial{ "adversarial", {} };
+        addPuzzles(adversarial, dir + "CorpusAdversarial.txt");
+        corpora.push_back(adversarial);
+    }
+    for (const auto& [name, fn] : options.corpusFiles) {
+        Corpus corpus{ name, {} };
+        if (!addPuzzles(corpus, fn)) return 1;
+        corpora.push_back(corpus);
+    }
+
+    vector<CorpusResult> results;
+    bool allSolved = checkReader(dir + "CorpusMalformed.txt");
+    for (const Corpus& corpus : corpora) {
+        vector<double> firstFastest;
+        for (size_t idx=0; idx < options.backends.size(); idx++) {
+            CorpusResult result = measure(corpus, options.repeat, options.backends[idx], options.policy);
+            if (idx == 0) {
+                firstFastest = result.fastestUs;
+            }
+            else {
+                result.name += string("/") + backendName(options.backends[idx]);
+                result.fasterThanFirst = 0;
+                for (size_t puzzle=0; puzzle < result.puzzles; puzzle++) {
+                    if (result.fastestUs[puzzle] < firstFastest[puzzle]) result.fasterThanFirst++;
+                }
+            }
+            fprintf(stderr, "%-16s %6zu puzzles %12.0f/s  p50 %9.1fus  p99 %9.1fus  max %9.1fus  %8.2f guesses  %.2f allocs\n",
+                    result.name.c_str(), result.puzzles, result.puzzlesPerSec, result.p50Us, result.p99Us,
+                    result.maxUs, result.guessesPerPuzzle, result.allocationsPerPuzzle);
+            if (result.fasterThanFirst >= 0) {
+                cerr << result.name << ": faster than " << backendName(options.backends[0]) << " on " <<
+                    result.fasterThanFirst << " of " << result.puzzles << " puzzles" << endl;
+            }
+            if (result.solved != result.puzzles) {
+                cerr << result.name << ": only " << result.solved << " of " << result.puzzles << " puzzles solved" << endl;
+                allSolved = false;
+            }
+            results.push_back(result);
+        }
+    }
+
+    vector<ValidatorResult> validators;
+    if (options.validate > 0) {
+        mt19937 rng(options.seed);
+        const vector<uint8_t> grids = randomGrids(rng, options.validate);
+        for (ValidatorKind kind : { ValidatorKind::SCALAR, ValidatorKind::SSE4, ValidatorKind::AVX2 }) {
+            if (kind > bestValidator()) continue;
+            ValidatorResult validator;
+            if (!measureValidator(grids, options.repeat, kind, validator)) {
+                cerr << validator.name << ": disagrees with the scalar check" << endl;
+                allSolved = false;
+            }
+            fprintf(stderr, "%-16s %6zu grids %14.0f/s  %zu valid\n",
+                    validator.name.c_str(), validator.grids, validator.gridsPerSec, validator.valid);
+            validators.push_back(validator);
+        }
+    }
+
+    vector<string> regressions;
+    bool comparing = !options.baselineFile.empty();
+    if (comparing && !compareWithBaseline(results, validators, options.baselineFile, options.tolerance, regressions)) {
+        return 1;
+    }
+    for (const string& regression : regressions) {
+        cerr << "REGRESSION " << regression << endl;
+    }
+
+    if (options.outputFile.empty()) {
+        writeJson(cout, options, results, validators, comparing ? &regressions : nullptr);
+    }
+    else {
+        ofstream out(options.outputFile);
+        writeJson(out, options, results, validators, comparing ? &regressions : nullptr);
+        if (!out.good()) {
+            cerr << options.outputFile << ": failed to write file" << endl;
+            return 1;
+        }
+    }
+    return (allSolved && regressions.empty()) ? 0 : 1;
+}
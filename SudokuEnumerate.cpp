@@ -0,0 +1,390 @@
+//============================================================================
+// Name        : SudokuEnumerate.cpp
+// Author      : Jeff Hancock
+//               https://www.linkedin.com/in/jeffreythancock/
+// Copyright   : Carte blanche.  Plagiarize at will.
+// Description : Counts (or writes out) every solution of a puzzle with few
+//               givens, for runs that take hours.  The search is split into
+//               independent parts a few guesses down, which are shared out
+//               among threads; the parts finished so far and the running
+//               count are checkpointed to a file, so a run that is stopped
+//               picks up where it left off.
+//============================================================================
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <mutex>
+#include <chrono>
+#include <climits>
+#include <cstdio>
+#include <cstdint>
+#include <cinttypes>
+#include <unistd.h>
+#include "SudokuPuzzle.h"
+#include "ThreadPool.h"
+using namespace std;
+
+// What to do, from the command line.
+struct EnumerateOptions {
+    // The number of rows (and columns) of the puzzle.
+    int size = 9;
+    unsigned threads = 0;
+    // Split the search until there are at least this many parts; zero for 64 per thread.
+    size_t parts = 0;
+    // Seconds between checkpoints.
+    double interval = 60;
+    string puzzleFile;
+    // Where the progress is kept.  Empty for puzzleFile with ".checkpoint" on the end.
+    string checkpointFile;
+    // Where to write every solution, one per line.  Empty to just count them.
+    string solutionsFile;
+};
+
+// How far a run has got: which parts are finished, and what they came to.  Kept in
+// the checkpoint file as lines of "name value", e.g.
+//    puzzle 1.......2.....
+//    levels 3
+//    parts 1843
+//    hash 9C3F...
+//    solutions 1234567
+//    writing 1
+//    output 117283840
+//    done FFFF0F...
+// where hash identifies the parts the puzzle splits into, writing is 1 if solutions
+// are being written out, output is the length of the solutions file when the
+// checkpoint was taken, and done has a bit per part, four to a hex digit, part 0 the
+// low bit of the first digit.
+struct Progress {
+    string puzzle;
+    int levels = 0;
+    uint64_t hash = 0;
+    uint64_t solutions = 0;
+    bool writing = false;
+    uint64_t outputBytes = 0;
+    vector<uint8_t> done;
+
+    size_t doneCount() const {
+        size_t count = 0;
+        for (uint8_t flag : done) count += flag;
+        return count;
+    }
+};
+
+// FNV-1a, carried on over more bytes.
+uint64_t hashBytes(uint64_t hash, const uint8_t* data, const size_t count) {
+    for (size_t idx=0; idx < count; idx++) {
+        hash = (hash ^ data[idx]) * 0x100000001B3ull;
+    }
+    return hash;
+}
+
+// Write the progress to a new file and rename it over the checkpoint, so a run killed
+// part way through leaves the last checkpoint whole.
+// Return value:
+//    true - OK
+//    false - the file couldn't be written
+bool writeCheckpoint(const string& fn, const Progress& progress) {
+    string temp = fn + ".tmp";
+    FILE* file = fopen(temp.c_str(), "w");
+    if (file == nullptr) return false;
+    string done;
+    for (size_t idx=0; idx < progress.done.size(); idx += 4) {
+        int digit = 0;
+        for (size_t bit=0; bit < 4 && idx + bit < progress.done.size(); bit++) {
+            if (progress.done[idx + bit]) digit |= 1 << bit;
+        }
+        done += "0123456789ABCDEF"[digit];
+    }
+    fprintf(file, "puzzle %s\nlevels %d\nparts %zu\nhash %016" PRIX64 "\nsolutions %" PRIu64 "\nwriting %d\noutput %" PRIu64
+            "\ndone %s\n", progress.puzzle.c_str(), progress.levels, progress.done.size(), progress.hash, progress.solutions,
+            progress.writing ? 1 : 0, progress.outputBytes, done.c_str());
+    bool ok = fflush(file) == 0 && fsync(fileno(file)) == 0;
+    ok = fclose(file) == 0 && ok;
+    return ok && rename(temp.c_str(), fn.c_str()) == 0;
+}
+
+// Read a checkpoint written by writeCheckpoint().
+// Return value:
+//    true - progress holds it
+//    false - there's no such file, or it isn't a checkpoint
+bool readCheckpoint(const string& fn, Progress& progress) {
+    FILE* file = fopen(fn.c_str(), "r");
+    if (file == nullptr) return false;
+    progress = Progress();
+    size_t numParts = 0;
+    string done;
+    int fields = 0;
+    char name[32];
+    string value;
+    int ch;
+    while (fscanf(file, "%31s", name) == 1) {
+        value.clear();
+        while ((ch = fgetc(file)) == ' ') {}
+        for (; ch != EOF && ch != '\n'; ch = fgetc(file)) value += char(ch);
+        string field = name;
+        if (field == "puzzle") progress.puzzle = value;
+        else if (field == "levels") progress.levels = atoi(value.c_str());
+        else if (field == "parts") numParts = size_t(strtoull(value.c_str(), nullptr, 10));
+        else if (field == "hash") progress.hash = strtoull(value.c_str(), nullptr, 16);
+        else if (field == "solutions") progress.solutions = strtoull(value.c_str(), nullptr, 10);
+        else if (field == "writing") progress.writing = value == "1";
+        else if (field == "output") progress.outputBytes = strtoull(value.c_str(), nullptr, 10);
+        else if (field == "done") done = value;
+        else continue;
+        fields++;
+    }
+    fclose(file);
+    if (fields != 8 || done.size() != (numParts + 3) / 4) return false;
+    progress.done.assign(numParts, 0);
+    for (size_t idx=0; idx < numParts; idx++) {
+        int digit = charToValue(done[idx / 4]);
+        if (digit < 0 || digit > 15) return false;
+        progress.done[idx] = uint8_t(digit >> (idx % 4) & 1);
+    }
+    return true;
+}
+
+// The puzzle in the one line format.
+template <int SIZE>
+string toLine(const uint8_t* cells) {
+    string line;
+    for (int idx=0; idx < SIZE * SIZE; idx++) line += valueToChar(cells[idx]);
+    return line;
+}
+
+// Count or write out every solution of the first puzzle in options.puzzleFile,
+// resuming from the checkpoint if there is one for the same puzzle.
+// Return value:
+//    0 - every part was searched
+//    1 - the puzzle couldn't be read or its givens clash, or a file couldn't be
+//        read or written
+template <typename Puzzle>
+int enumerate(const EnumerateOptions& options) {
+    constexpr int SIZE = Puzzle::SIZE;
+    constexpr int NUM_SPOTS = SIZE * SIZE;
+    LineSource source;
+    if (!source.open(options.puzzleFile)) {
+        cerr << "Failed to open file: " << options.puzzleFile << endl;
+        return 1;
+    }
+    PuzzleReader<SIZE> reader(source);
+    uint8_t cells[NUM_SPOTS];
+    ParseError error;
+    if (!reader.next(cells, error) || !error.ok()) {
+        cerr << options.puzzleFile << ": " << (error.ok() ? "no puzzle" : describe(error)) << endl;
+        return 1;
+    }
+    const string checkpointFile = options.checkpointFile.empty() ? options.puzzleFile + ".checkpoint" :
+                                  options.checkpointFile;
+    ThreadPool pool(options.threads);
+
+    // Pick up the last run's progress if it was on the same puzzle; the parts are split
+    // as deep as they were then, so they come out the same.
+    Progress progress;
+    bool resuming = readCheckpoint(checkpointFile, progress) && progress.puzzle == toLine<SIZE>(cells);
+    if (!resuming) {
+        progress = Progress();
+        progress.puzzle = toLine<SIZE>(cells);
+    }
+    const size_t wanted = options.parts != 0 ? options.parts : 64 * size_t(pool.size());
+    Puzzle sp(cells);
+    vector<uint8_t> parts;
+    for (int levels = resuming ? progress.levels : 1; ; levels++) {
+        if (!sp.partitionSearch(levels, parts)) {
+            cerr << "The givens clash; there are no solutions." << endl;
+            return 1;
+        }
+        progress.levels = levels;
+        // Going deeper can't make more parts once every one is solved.
+        bool allSolved = true;
+        for (size_t idx=0; idx < parts.size() && allSolved; idx++) allSolved = parts[idx] != 0;
+        if (resuming || parts.size() / NUM_SPOTS >= wanted || allSolved || levels >= NUM_SPOTS) break;
+    }
+    const size_t numParts = parts.size() / NUM_SPOTS;
+    const uint64_t hash = hashBytes(0xCBF29CE484222325ull, parts.data(), parts.size());
+    if (resuming && (hash != progress.hash || numParts != progress.done.size())) {
+        cerr << checkpointFile << ": doesn't match how the puzzle splits up; remove it to start again" << endl;
+        return 1;
+    }
+    // Without the solutions of the parts already done, the file would be missing some;
+    // with them, it would hold some twice.
+    const bool writing = !options.solutionsFile.empty();
+    if (resuming && writing != progress.writing) {
+        cerr << checkpointFile << ": the run was started " << (progress.writing ? "with" : "without") <<
+                " --solutions; carry on the same way or remove it to start again" << endl;
+        return 1;
+    }
+    if (!resuming) {
+        progress.hash = hash;
+        progress.writing = writing;
+        progress.done.assign(numParts, 0);
+    }
+
+    // The solutions file is cut back to where it was at the checkpoint: anything after
+    // that came from parts that will be searched again.
+    FILE* output = nullptr;
+    if (writing) {
+        output = fopen(options.solutionsFile.c_str(), resuming ? "r+" : "w");
+        if (output == nullptr || (resuming && truncate(options.solutionsFile.c_str(), off_t(progress.outputBytes)) != 0) ||
+            fseek(output, long(progress.outputBytes), SEEK_SET) != 0) {
+            cerr << "Failed to open file: " << options.solutionsFile << endl;
+            if (output != nullptr) fclose(output);
+            return 1;
+        }
+    }
+    if (resuming) {
+        cerr << "Resuming: " << progress.doneCount() << " of " << numParts << " parts done, " << progress.solutions <<
+                " solutions so far" << endl;
+    }
+    else {
+        cerr << "Split into " << numParts << " parts, " << progress.levels << " guesses deep" << endl;
+    }
+
+    vector<size_t> pending;
+    for (size_t idx=0; idx < numParts; idx++) {
+        if (!progress.done[idx]) pending.push_back(idx);
+    }
+    mutex progressLock;
+    bool ok = writeCheckpoint(checkpointFile, progress);
+    auto start = chrono::steady_clock::now();
+    auto lastCheckpoint = start;
+    size_t finishedThisRun = 0;
+
+    // Parts can take hours, so they are handed out one at a time.
+    pool.forEach(pending.size(), [&](size_t task, unsigned) {
+        const size_t idx = pending[task];
+        Puzzle part(*reinterpret_cast<const uint8_t (*)[NUM_SPOTS]>(&parts[idx * NUM_SPOTS]));
+        long count;
+        bool partOk = true;
+        FILE* partFile = nullptr;
+        if (output != nullptr) {
+            // A part may have more solutions than fit in memory, so they go to a file of
+            // its own, removed as soon as it's open so a killed run leaves none behind.
+            string partName = options.solutionsFile + ".part" + to_string(idx);
+            partFile = fopen(partName.c_str(), "w+");
+            if (partFile != nullptr) unlink(partName.c_str());
+            partOk = partFile != nullptr;
+            uint8_t solution[NUM_SPOTS];
+            char line[NUM_SPOTS + 1];
+            line[NUM_SPOTS] = '\n';
+            count = part.forEachSolution(LONG_MAX, [&](const Puzzle& solved) {
+                if (partFile == nullptr) return;
+                solved.getCells(solution);
+                for (int spot=0; spot < NUM_SPOTS; spot++) line[spot] = valueToChar(solution[spot]);
+                fwrite(line, 1, sizeof(line), partFile);
+            });
+        }
+        else {
+            count = part.countSolutions(LONG_MAX);
+        }
+
+        // The part's solutions are copied to the file along with marking it done, so the
+        // file and a checkpoint always agree.
+        lock_guard<mutex> guard(progressLock);
+        if (partFile != nullptr) {
+            partOk = fflush(partFile) == 0 && !ferror(partFile) && fseek(partFile, 0, SEEK_SET) == 0;
+            vector<char> block(1 << 20);
+            size_t got;
+            while (partOk && (got = fread(block.data(), 1, block.size(), partFile)) > 0) {
+                partOk = fwrite(block.data(), 1, got, output) == got;
+                progress.outputBytes += got;
+            }
+            fclose(partFile);
+        }
+        ok = partOk && ok;
+        progress.solutions += uint64_t(count);
+        progress.done[idx] = 1;
+        finishedThisRun++;
+        auto now = chrono::steady_clock::now();
+        // Once anything has failed to be written, the last good checkpoint is left to
+        // resume from.
+        if (ok && chrono::duration<double>(now - lastCheckpoint).count() >= options.interval) {
+            if (output != nullptr) ok = fflush(output) == 0 && fsync(fileno(output)) == 0;
+            ok = ok && writeCheckpoint(checkpointFile, progress);
+            lastCheckpoint = now;
+            const double seconds = chrono::duration<double>(now - start).count();
+            fprintf(stderr, "%zu of %zu parts done, %" PRIu64 " solutions so far (%.1f parts/s)\n",
+                    progress.doneCount(), numParts, progress.solutions, double(finishedThisRun) / seconds);
+        }
+    }, 1);
+
+    if (output != nullptr) {
+        ok = fflush(output) == 0 && ok;
+        ok = fclose(output) == 0 && ok;
+    }
+    ok = ok && writeCheckpoint(checkpointFile, progress);
+    if (!ok) {
+        cerr << "Failed to write the checkpoint or solutions" << endl;
+        return 1;
+    }
+    const double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    cerr << "Searched " << finishedThisRun << " parts in " << seconds << "s using " << pool.size() << " threads" << endl;
+    cout << progress.solutions << " solutions" << endl;
+    return 0;
+}
+
+void printUsage() {
+    cerr << "Usage: SudokuEnumerate [options] FILE" << endl;
+    cerr << "Count every solution of the first puzzle in FILE, checkpointing as it goes so an" << endl;
+    cerr << "interrupted run can be started again with the same arguments and carry on." << endl;
+    cerr << "  --size N            Puzzle is N x N: 4, 6, 8, 9 (default), 12, 16 or 25" << endl;
+    cerr << "  --threads N         Number of worker threads (default: one per hardware thread)" << endl;
+    cerr << "  --parts N           Split the search into at least N parts (default: 64 per thread)" << endl;
+    cerr << "  --checkpoint FILE   Where to keep progress (default: FILE.checkpoint)" << endl;
+    cerr << "  --interval S        Seconds between checkpoints (default: 60)" << endl;
+    cerr << "  --solutions FILE    Also write every solution to FILE, one per line" << endl;
+}
+
+// Enumerate with the puzzle type for options.size.
+int enumerateForSize(const EnumerateOptions& options) {
+    switch (options.size) {
+    case 4: return enumerate<BasicSudokuPuzzle<2, 2>>(options);
+    case 6: return enumerate<BasicSudokuPuzzle<2, 3>>(options);
+    case 8: return enumerate<BasicSudokuPuzzle<2, 4>>(options);
+    case 9: return enumerate<SudokuPuzzle>(options);
+    case 12: return enumerate<BasicSudokuPuzzle<3, 4>>(options);
+    case 16: return enumerate<BasicSudokuPuzzle<4, 4>>(options);
+    case 25: return enumerate<BasicSudokuPuzzle<5, 5>>(options);
+    default:
+        printUsage();
+        return 2;
+    }
+}
+
+int main(int argc, char* argv[]) {
+    EnumerateOptions options;
+    for (int arg=1; arg < argc; arg++) {
+        string opt = argv[arg];
+        if (opt == "--size" && arg + 1 < argc) {
+            options.size = atoi(argv[++arg]);
+        }
+        else if (opt == "--threads" && arg + 1 < argc) {
+            options.threads = unsigned(atoi(argv[++arg]));
+        }
+        else if (opt == "--parts" && arg + 1 < argc) {
+            options.parts = size_t(atol(argv[++arg]));
+        }
+        else if (opt == "--checkpoint" && arg + 1 < argc) {
+            options.checkpointFile = argv[++arg];
+        }
+        else if (opt == "--interval" && arg + 1 < argc) {
+            options.interval = atof(argv[++arg]);
+        }
+        else if (opt == "--solutions" && arg + 1 < argc) {
+            options.solutionsFile = argv[++arg];
+        }
+        else if (opt[0] != '-' && options.puzzleFile.empty()) {
+            options.puzzleFile = opt;
+        }
+        else {
+            printUsage();
+            return 2;
+        }
+    }
+    if (options.puzzleFile.empty()) {
+        printUsage();
+        return 2;
+    }
+    return enumerateForSize(options);
+}
@@ -0,0 +1,51 @@
+//============================================================================
+// Name        : SudokuLibrary.cpp
+// Author      : Jeff Hancock
+//               https://www.linkedin.com/in/jeffreythancock/
+// Copyright   : Carte blanche.  Plagiarize at will.
+// Description : The library half of the solver: the puzzle templates built
+//               once for each supported size.  See SudokuLibrary.h.
+//============================================================================
+
+#include "SudokuLibrary.h"
+using namespace std;
+
+// Solve with the puzzle type for one size.
+template <typename Puzzle>
+SolveStatus solveAs(const uint8_t* cells, uint8_t* solution, const SolverBackend backend, SolverStats* stats) {
+    uint8_t given[Puzzle::NUM_SPOTS];
+    copy(cells, cells + Puzzle::NUM_SPOTS, given);
+    Puzzle sp(given);
+    sp.setBackend(backend);
+    uint8_t (&result)[Puzzle::NUM_SPOTS] = *reinterpret_cast<uint8_t (*)[Puzzle::NUM_SPOTS]>(solution);
+    SolveStatus status = sp.solveInto(result);
+    if (stats != nullptr) *stats = sp.getStats();
+    return status;
+}
+
+bool isSupportedSize(const int size) {
+    switch (size) {
+    case 4: case 6: case 8: case 9: case 12: case 16: case 25:
+        return true;
+    default:
+        return false;
+    }
+}
+
+// Boxes are as wide as they are high where possible, and otherwise one row shorter
+// than they are wide, as for SudokuSolver --size.
+SolveStatus solveSudoku(const int size, const uint8_t* cells, uint8_t* solution,
+                        const SolverBackend backend, SolverStats* stats) {
+    switch (size) {
+    case 4: return solveAs<BasicSudokuPuzzle<2, 2>>(cells, solution, backend, stats);
+    case 6: return solveAs<BasicSudokuPuzzle<2, 3>>(cells, solution, backend, stats);
+    case 8: return solveAs<BasicSudokuPuzzle<2, 4>>(cells, solution, backend, stats);
+    case 9: return solveAs<SudokuPuzzle>(cells, solution, backend, stats);
+    case 12: return solveAs<BasicSudokuPuzzle<3, 4>>(cells, solution, backend, stats);
+    case 16: return solveAs<BasicSudokuPuzzle<4, 4>>(cells, solution, backend, stats);
+    case 25: return solveAs<BasicSudokuPuzzle<5, 5>>(cells, solution, backend, stats);
+    default:
+        if (stats != nullptr) *stats = SolverStats();
+        return SolveStatus::INVALID;
+    }
+}
@@ -0,0 +1,30 @@
+//============================================================================
+// Name        : SudokuLibrary.h
+// Author      : Jeff Hancock
+//               https://www.linkedin.com/in/jeffreythancock/
+// Copyright   : Carte blanche.  Plagiarize at will.
+// Description : The solver behind a plain function, for programs that link
+//               against libsudoku.a (built from SudokuLibrary.cpp) rather
+//               than compiling the templates in SudokuPuzzle.h themselves.
+//               Nothing here reads or writes stdin, stdout or stderr.
+//============================================================================
+
+#ifndef SUDOKULIBRARY_H
+#define SUDOKULIBRARY_H
+
+#include <cstdint>
+#include "SudokuPuzzle.h"
+
+// Whether solveSudoku() handles size x size puzzles: 4, 6, 8, 9, 12, 16 or 25.
+bool isSupportedSize(const int size);
+
+// Solve a size x size puzzle given as size * size values, one row after another,
+// with zero for a blank, and write the solution the same way into solution (which
+// may be the same buffer as cells).  Safe to call from any number of threads at once.
+//    backend - the algorithm to use
+//    stats - if not null, set to what the solver did
+// Return value: see SolveStatus.  An unsupported size is INVALID.
+SolveStatus solveSudoku(const int size, const uint8_t* cells, uint8_t* solution,
+                        const SolverBackend backend = SolverBackend::PROPAGATION, SolverStats* stats = nullptr);
+
+#endif // SUDOKULIBRARY_H
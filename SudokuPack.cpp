@@ -0,0 +1,201 @@
+//============================================================================
+// Name        : SudokuPack.cpp
+// Author      : Jeff Hancock
+//               https://www.linkedin.com/in/jeffreythancock/
+// Copyright   : Carte blanche.  Plagiarize at will.
+// Description : Converts puzzles in any of the text formats the solver reads
+//               to a packed corpus (see PackedCorpus.h), optionally solving
+//               them on the way, and back again; or checks a packed corpus.
+//============================================================================
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <cstdio>
+#include <cstdint>
+#include "SudokuPuzzle.h"
+#include "PackedCorpus.h"
+using namespace std;
+
+// What to do, from the command line.
+struct PackOptions {
+    enum class Action { PACK, UNPACK, VERIFY };
+    Action action = Action::PACK;
+    // The number of rows (and columns) of the puzzles when packing.
+    int size = 9;
+    // Store each puzzle's solution after it.
+    bool solutions = false;
+    // The packed corpus, written when packing and read otherwise.
+    string packedFile;
+    // The text files to pack.  Empty or "-" for stdin.
+    vector<string> inputFiles;
+};
+
+// Pack every puzzle of the input files into options.packedFile.  Malformed puzzles
+// are reported on stderr and left out.
+// Return value:
+//    0 - every puzzle was packed
+//    1 - some were malformed, or a file couldn't be read or written
+template <typename Puzzle>
+int pack(const PackOptions& options) {
+    constexpr int SIZE = Puzzle::SIZE;
+    PackedCorpusWriter writer;
+    if (!writer.open(options.packedFile, SIZE, options.solutions)) {
+        cerr << "Failed to create file: " << options.packedFile << endl;
+        return 1;
+    }
+
+    vector<string> inputFiles = options.inputFiles;
+    if (inputFiles.empty()) inputFiles.push_back("-");
+    uint8_t cells[SIZE * SIZE];
+    uint8_t solution[SIZE * SIZE];
+    size_t numBad = 0;
+    size_t numUnsolved = 0;
+    for (const string& fn : inputFiles) {
+        LineSource source;
+        if (!source.open(fn)) {
+            cerr << "Failed to open file: " << fn << endl;
+            return 1;
+        }
+        PuzzleReader<SIZE> reader(source);
+        ParseError error;
+        while (reader.next(cells, error)) {
+            if (!error.ok()) {
+                cerr << fn << ": " << describe(error) << endl;
+                numBad++;
+                continue;
+            }
+            bool solved = false;
+            if (options.solutions) {
+                Puzzle sp(cells);
+                solved = sp.solveInto(solution) == SolveStatus::SOLVED;
+                if (!solved) numUnsolved++;
+            }
+            if (!writer.add(cells, solved ? solution : nullptr)) {
+                cerr << "Failed to write file: " << options.packedFile << endl;
+                return 1;
+            }
+        }
+    }
+    size_t count = writer.puzzleCount();
+    if (!writer.close()) {
+        cerr << "Failed to write file: " << options.packedFile << endl;
+        return 1;
+    }
+    cerr << "Packed " << count << " puzzles";
+    if (options.solutions) cerr << " (" << numUnsolved << " without a solution)";
+    cerr << ", " << numBad << " malformed" << endl;
+    return numBad == 0 ? 0 : 1;
+}
+
+// Write every puzzle of the packed corpus to stdout in the one line format, followed
+// by a space and its solution if it has one.
+// Return value:
+//    0 - OK
+//    1 - the file isn't a readable packed corpus
+int unpack(const PackOptions& options) {
+    PackedCorpus corpus;
+    if (!corpus.open(options.packedFile)) {
+        cerr << options.packedFile << ": " << corpus.error() << endl;
+        return 1;
+    }
+    ios::sync_with_stdio(false);
+    const int numSpots = corpus.gridSize() * corpus.gridSize();
+    vector<uint8_t> cells(static_cast<size_t>(numSpots));
+    vector<uint8_t> solution(static_cast<size_t>(numSpots));
+    string line;
+    while (corpus.next(cells.data(), solution.data())) {
+        line.clear();
+        for (int idx=0; idx < numSpots; idx++) line += valueToChar(cells[idx]);
+        if (corpus.hasSolutions() && solution[0] != 0) {
+            line += ' ';
+            for (int idx=0; idx < numSpots; idx++) line += valueToChar(solution[idx]);
+        }
+        line += '\n';
+        cout << line;
+    }
+    return 0;
+}
+
+// Check the header and hash of the packed corpus, and say what it holds.
+// Return value:
+//    0 - the corpus is intact
+//    1 - it isn't
+int verify(const PackOptions& options) {
+    PackedCorpus corpus;
+    if (!corpus.open(options.packedFile)) {
+        cerr << options.packedFile << ": " << corpus.error() << endl;
+        return 1;
+    }
+    if (!corpus.verify()) {
+        cerr << options.packedFile << ": hash doesn't match; the file is damaged" << endl;
+        return 1;
+    }
+    cout << options.packedFile << ": " << corpus.puzzleCount() << " puzzles, " << corpus.gridSize() <<
+            "x" << corpus.gridSize() << (corpus.hasSolutions() ? ", with solutions" : "") << endl;
+    return 0;
+}
+
+void printUsage() {
+    cerr << "Usage: SudokuPack [options] PACKED [file...]   Pack puzzles from files (or stdin)" << endl;
+    cerr << "       SudokuPack --unpack PACKED              Write the puzzles one per line" << endl;
+    cerr << "       SudokuPack --verify PACKED              Check a packed corpus" << endl;
+    cerr << "  --size N      Puzzles are N x N: 4, 6, 8, 9 (default), 12, 16 or 25" << endl;
+    cerr << "  --solutions   Solve each puzzle and store the solution with it" << endl;
+}
+
+// Pack with the puzzle type for options.size.
+int packForSize(const PackOptions& options) {
+    switch (options.size) {
+    case 4: return pack<BasicSudokuPuzzle<2, 2>>(options);
+    case 6: return pack<BasicSudokuPuzzle<2, 3>>(options);
+    case 8: return pack<BasicSudokuPuzzle<2, 4>>(options);
+    case 9: return pack<SudokuPuzzle>(options);
+    case 12: return pack<BasicSudokuPuzzle<3, 4>>(options);
+    case 16: return pack<BasicSudokuPuzzle<4, 4>>(options);
+    case 25: return pack<BasicSudokuPuzzle<5, 5>>(options);
+    default:
+        printUsage();
+        return 2;
+    }
+}
+
+int main(int argc, char* argv[]) {
+    PackOptions options;
+    vector<string> files;
+    for (int arg=1; arg < argc; arg++) {
+        string opt = argv[arg];
+        if (opt == "--unpack") {
+            options.action = PackOptions::Action::UNPACK;
+        }
+        else if (opt == "--verify") {
+            options.action = PackOptions::Action::VERIFY;
+        }
+        else if (opt == "--solutions") {
+            options.solutions = true;
+        }
+        else if (opt == "--size" && arg + 1 < argc) {
+            options.size = atoi(argv[++arg]);
+        }
+        else if (opt == "-" || opt[0] != '-') {
+            files.push_back(opt);
+        }
+        else {
+            printUsage();
+            return 2;
+        }
+    }
+    if (files.empty() || (options.action != PackOptions::Action::PACK && files.size() != 1)) {
+        printUsage();
+        return 2;
+    }
+    options.packedFile = files[0];
+    options.inputFiles.assign(files.begin() + 1, files.end());
+
+    switch (options.action) {
+    case PackOptions::Action::UNPACK: return unpack(options);
+    case PackOptions::Action::VERIFY: return verify(options);
+    case PackOptions::Action::PACK: break;
+    }
+    return packForSize(options);
+}
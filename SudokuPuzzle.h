@@ -0,0 +1,2731 @@
+//============================================================================
+// Name        : SudokuPuzzle.h
+// Author      : Jeff Hancock
+//               https://www.linkedin.com/in/jeffreythancock/
+// Copyright   : Carte blanche.  Plagiarize at will.
+// Description : The Sudoku puzzle and solver, along with the readers for the
+//               puzzle file formats.  Everything is a template or inline, so
+//               including this is all that's needed to use it.
+//============================================================================
+
+#ifndef SUDOKUPUZZLE_H
+#define SUDOKUPUZZLE_H
+
+#include <iostream>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <mutex>
+#include <deque>
+#include <functional>
+#include <algorithm>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <type_traits>
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
+#include <cerrno>
+#include <bit>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// The number of values in a mask of candidate values.
+template <typename Mask>
+inline int countCandidates(const Mask mask) {
+    return std::popcount(mask);
+}
+
+// The smallest value in a non-empty mask of candidate values.
+template <typename Mask>
+inline int lowestCandidate(const Mask mask) {
+    return std::countr_zero(mask) + 1;
+}
+
+// The character used for a value in the one line puzzle format and when printing:
+// '1' - '9', then 'A' onwards for grids with more than nine values.
+inline char valueToChar(const int value) {
+    return value <= 9 ? char('0' + value) : char('A' + value - 10);
+}
+
+// The value for a character as written by valueToChar(), accepting lower case
+// letters too, or -1 if it isn't one.  '0' gives zero (a blank).
+inline int charToValue(const char c) {
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'A' && c <= 'Z') return c - 'A' + 10;
+    if (c >= 'a' && c <= 'z') return c - 'a' + 10;
+    return -1;
+}
+
+// The dimensions of a puzzle whose submatrices (boxes) are BOX_ROWS high and
+// BOX_COLS wide.  There are SIZE = BOX_ROWS * BOX_COLS values, and as many rows,
+// columns and boxes.  Boxes are numbered left to right, then top to bottom.
+template <int BOX_ROWS, int BOX_COLS>
+struct GridShape {
+    static_assert(BOX_ROWS >= 1 && BOX_COLS >= 1 && BOX_ROWS * BOX_COLS <= 64, "grids up to 64x64 are supported");
+
+    static constexpr int SIZE = BOX_ROWS * BOX_COLS;
+    static constexpr int NUM_SPOTS = SIZE * SIZE;
+    // Rows, then columns, then boxes.
+    static constexpr int NUM_UNITS = 3 * SIZE;
+    // The other spots in a spot's row and column, plus those in its box but not
+    // already counted.
+    static constexpr int NUM_PEERS = 3 * SIZE - BOX_ROWS - BOX_COLS - 1;
+
+    // Candidate values for a blank spot are kept as a bitmask, with bit (value - 1)
+    // set when value is still possible.  The narrowest type that fits is used, so
+    // the 9x9 masks stay at 16 bits.
+    typedef std::conditional_t<SIZE <= 16, uint16_t, std::conditional_t<SIZE <= 32, uint32_t, uint64_t>> Mask;
+
+    // Values 1 through SIZE.
+    static constexpr Mask ALL_CANDIDATES = Mask(Mask(~Mask(0)) >> (8 * sizeof(Mask) - SIZE));
+
+    // The index of the box containing the given spot.
+    static constexpr int boxIndex(const int row, const int col) {
+        return BOX_ROWS * (row / BOX_ROWS) + col / BOX_COLS;
+    }
+};
+
+// A spot on the board.
+struct Spot {
+    uint8_t row;
+    uint8_t col;
+};
+
+// For each spot on the board, the other spots that share its row, column or box,
+// and so can't have the same value, in row-major order.  Built at compile time.
+template <int BOX_ROWS, int BOX_COLS>
+struct PeerTable {
+    typedef GridShape<BOX_ROWS, BOX_COLS> Shape;
+
+    Spot peers[Shape::SIZE][Shape::SIZE][Shape::NUM_PEERS];
+
+    constexpr PeerTable() : peers{} {
+        for (int row=0; row < Shape::SIZE; row++) {
+            for (int col=0; col < Shape::SIZE; col++) {
+                int numPeers = 0;
+                const int boxLeft = BOX_COLS * (col / BOX_COLS);
+                for (int peerRow=0; peerRow < Shape::SIZE; peerRow++) {
+                    if (peerRow == row) {
+                        for (int peerCol=0; peerCol < Shape::SIZE; peerCol++) {
+                            if (peerCol == col) continue;
+                            peers[row][col][numPeers++] = Spot{ uint8_t(peerRow), uint8_t(peerCol) };
+                        }
+                    }
+                    else if (peerRow / BOX_ROWS == row / BOX_ROWS) {
+                        // Another row of the same box: the spots in the box's columns.
+                        for (int peerCol=boxLeft; peerCol < boxLeft + BOX_COLS; peerCol++) {
+                            peers[row][col][numPeers++] = Spot{ uint8_t(peerRow), uint8_t(peerCol) };
+                        }
+                    }
+                    else {
+                        peers[row][col][numPeers++] = Spot{ uint8_t(peerRow), uint8_t(col) };
+                    }
+                }
+            }
+        }
+    }
+};
+
+// The units of the board that must each hold every value exactly once: rows
+// (units 0 to SIZE - 1), then columns, then boxes.  Spots within a box are listed
+// left to right, then top to bottom.  Built at compile time.
+template <int BOX_ROWS, int BOX_COLS>
+struct UnitTable {
+    typedef GridShape<BOX_ROWS, BOX_COLS> Shape;
+
+    Spot spots[Shape::NUM_UNITS][Shape::SIZE];
+
+    constexpr UnitTable() : spots{} {
+        constexpr int SIZE = Shape::SIZE;
+        for (int idx=0; idx < SIZE; idx++) {
+            for (int pos=0; pos < SIZE; pos++) {
+                spots[idx][pos] = Spot{ uint8_t(idx), uint8_t(pos) };
+                spots[SIZE + idx][pos] = Spot{ uint8_t(pos), uint8_t(idx) };
+                spots[2 * SIZE + idx][pos] = Spot{ uint8_t(BOX_ROWS * (idx / BOX_ROWS) + pos / BOX_COLS),
+                                                   uint8_t(BOX_COLS * (idx % BOX_ROWS) + pos % BOX_COLS) };
+            }
+        }
+    }
+};
+
+// Logical deductions that solve() can make before it resorts to guessing.  Setting
+// a spot that has only one possibility left is always done; these are the rest.
+// Combine them with | and pass them to BasicSudokuPuzzle::setRules().
+enum DeductionRule : unsigned {
+    // A value that has only one possible spot in a row, column or submatrix.
+    HIDDEN_SINGLES = 1u << 0,
+    // Two spots in a unit with the same two possibilities; no other spot in the
+    // unit can have either value.
+    NAKED_PAIRS = 1u << 1,
+    // Three spots in a unit whose possibilities come to three values in total.
+    NAKED_TRIPLES = 1u << 2,
+    // Two values that are only possible in the same two spots of a unit; those
+    // spots can't have any other value.
+    HIDDEN_PAIRS = 1u << 3,
+    // Three values that are only possible in the same three spots of a unit.
+    HIDDEN_TRIPLES = 1u << 4,
+    // A value confined to one row or column within a submatrix can't be elsewhere
+    // in that row or column ("pointing"), and a value confined to one submatrix
+    // within a row or column can't be elsewhere in that submatrix ("claiming").
+    BOX_LINE_REDUCTION = 1u << 5,
+
+    NO_RULES = 0,
+    ALL_RULES = (1u << 6) - 1
+};
+
+enum class RowOrCol {
+    ROW,
+    COL
+};
+
+// How BasicSudokuPuzzle::solveParallel() picks among solutions found by its threads.
+enum class ParallelMode {
+    // Return the same solution solve() would, i.e. the first in search order.
+    DETERMINISTIC,
+    // Return whichever solution is found first, stopping everything as soon as
+    // there is one.
+    FAST
+};
+
+// What became of a puzzle given to BasicSudokuPuzzle::solveInto().
+enum class SolveStatus {
+    // Solved; the solution was written out.
+    SOLVED,
+    // The givens are consistent but there is no solution.
+    UNSOLVABLE,
+    // A value is out of range or repeated within a row, column or submatrix (or, for
+    // callers reading puzzles, the puzzle couldn't be read).
+    INVALID
+};
+
+// The algorithm BasicSudokuPuzzle::solve() and countSolutions() use.
+enum class SolverBackend {
+    // Set every forced spot and apply the deduction rules, guessing at the spot with
+    // the fewest possibilities only when that gets nowhere.
+    PROPAGATION,
+    // Knuth's Dancing Links (Algorithm X) on the exact cover form of the puzzle.  No
+    // deduction rules, but each step is very cheap, which tends to pay off when
+    // counting solutions and on larger grids.
+    DANCING_LINKS
+};
+
+// Where the PROPAGATION search guesses once nothing more is forced.  Part of a
+// SearchPolicy.
+enum class BranchRule {
+    // The blank spot with the fewest possibilities, the first one row by row if
+    // there's a tie ("minimum remaining values").
+    FEWEST_POSSIBILITIES,
+    // As FEWEST_POSSIBILITIES, but a tie goes to the spot with the most blank peers,
+    // as its value narrows down the most others.
+    MOST_BLANK_PEERS,
+    // As FEWEST_POSSIBILITIES, but a tie goes to the spot holding a value with the
+    // fewest places left in one of its units, i.e. the closest to a hidden single.
+    FEWEST_PLACES_TIEBREAK,
+    // The value with the fewest places left in some row, column or submatrix, trying
+    // each place in turn; or a spot, if one has fewer possibilities than that.
+    FEWEST_PLACES
+};
+
+// The order a guess tries its choices in.  Part of a SearchPolicy.
+enum class ValueOrder {
+    // Lowest value (or, branching on places, first place row by row) first.
+    ASCENDING,
+    // The choice that takes a possibility away from the fewest blank peers first;
+    // tends to reach a solution sooner.
+    LEAST_CONSTRAINING,
+    // The choice that takes a possibility away from the most blank peers first;
+    // tends to fail sooner, which can help proving there's no (other) solution.
+    MOST_CONSTRAINING
+};
+
+// How the PROPAGATION search guesses.  Chosen per puzzle with
+// BasicSudokuPuzzle::setSearchPolicy(); the default is the original first found
+// spot with the fewest possibilities, values lowest first.
+struct SearchPolicy {
+    BranchRule branch = BranchRule::FEWEST_POSSIBILITIES;
+    ValueOrder order = ValueOrder::ASCENDING;
+};
+
+// What the last solve(), solveParallel() or countSolutions() did.  The counts are
+// kept as the search goes, which costs no more than an increment here and there;
+// the clock is only read at the start and end of each phase.
+struct SolverStats {
+    // Calls to propagate(), each setting every spot that was forced at the time.
+    long propagationPasses = 0;
+    // Times one of the deduction rules made progress.
+    long ruleSuccesses = 0;
+    // Possibilities removed from blank spots, whether by values set in their peers
+    // or by the deduction rules.
+    long candidatesEliminated = 0;
+    // Values tried in spots where nothing was forced.
+    long guesses = 0;
+    // Guesses that didn't work out and were undone.
+    long backtracks = 0;
+    // The most guesses in effect at once.
+    int maxDepth = 0;
+    // Checking the board and working out the first possibilities.
+    std::chrono::nanoseconds setupTime{0};
+    // Everything after that: deducing, guessing and backtracking.
+    std::chrono::nanoseconds searchTime{0};
+};
+
+// Tracers receive each step of the search as it happens; give one as the Tracer
+// argument of BasicSudokuPuzzle.  NoTrace, the default, does nothing, and since all
+// of its functions are empty and inline, the calls compile away entirely.  A tracer
+// needs all of these functions, as static members.
+struct NoTrace {
+    // Nothing more is forced; the search will guess at row, col, which has count
+    // possibilities.
+    template <typename Puzzle>
+    static void guessing(const Puzzle&, const int /*row*/, const int /*col*/, const int /*count*/) {}
+    // The search is trying value at row, col, with depth guesses now in effect.
+    static void tryingValue(const int /*row*/, const int /*col*/, const int /*value*/, const int /*depth*/) {}
+    // A guess that didn't work out is being undone.
+    static void backtracking(const int /*row*/, const int /*col*/, const int /*value*/) {}
+    // A spot with only one possibility left is being set to it.
+    static void forcedValue(const int /*row*/, const int /*col*/, const int /*value*/) {}
+    // Setting forced values left some spot with no possibilities.
+    static void contradiction() {}
+    // Nothing more is forced, with blanksLeft spots still blank.
+    static void propagated(const int /*blanksLeft*/) {}
+    // A deduction rule made progress (rc 1) or found a contradiction (rc -1).
+    static void ruleApplied(const char* /*name*/, const int /*rc*/) {}
+};
+
+// Prints each step of the search to stdout.  Slow, but shows how a puzzle gets
+// solved.
+struct ConsoleTrace {
+    template <typename Puzzle>
+    static void guessing(const Puzzle& puzzle, const int row, const int col, const int count) {
+        puzzle.print();
+        puzzle.listPossibilities();
+        std::cout << "MinPossibilites: " << count << ", minRow: " << row << ", minCol: " << col << std::endl;
+    }
+    static void tryingValue(const int row, const int col, const int value, const int /*depth*/) {
+        std::cout << "Trying value " << value << " at row " << row << ", col " << col << std::endl;
+    }
+    static void backtracking(const int row, const int col, const int value) {
+        std::cout << "Value " << value << " at row " << row << ", col " << col << " didn't work out" << std::endl;
+    }
+    static void forcedValue(const int row, const int col, const int value) {
+        std::cout << "***** Gonna set row " << row << ", col " << col << " to " << value << std::endl;
+    }
+    static void contradiction() {
+        std::cout << "propagate found a spot with no possibilities" << std::endl;
+    }
+    static void propagated(const int blanksLeft) {
+        std::cout << "propagate returning " << blanksLeft << std::endl;
+    }
+    static void ruleApplied(const char* name, const int rc) {
+        std::cout << name << (rc == 1 ? " made progress" : " found a contradiction") << std::endl;
+    }
+};
+
+// What went wrong reading a puzzle, and where.
+struct ParseError {
+    enum class Code {
+        NONE,
+        // The file couldn't be opened.
+        OPEN_FAILED,
+        // The input holds no puzzles.
+        NO_PUZZLE,
+        // A value that isn't a blank or in the range 1 - SIZE.
+        BAD_VALUE,
+        // A one line puzzle without exactly SIZE * SIZE values.
+        WRONG_LENGTH,
+        // A row with more or fewer than SIZE values.
+        TOO_MANY_VALUES,
+        TOO_FEW_VALUES,
+        // The input ended, or a one line puzzle started, part way through a puzzle.
+        INCOMPLETE_PUZZLE
+    };
+
+    Code code = Code::NONE;
+    // The line the problem was found on, counting from one.
+    long line = 0;
+    // Where on the line, counting from one: the character, or for comma separated
+    // rows the value.  Zero when it doesn't apply.
+    int column = 0;
+
+    bool ok() const {
+        return code == Code::NONE;
+    }
+};
+
+// A message for a ParseError, e.g. "line 3, column 7: invalid value".
+inline std::string describe(const ParseError& error) {
+    std::string where;
+    if (error.line != 0) {
+        where = "line " + std::to_string(error.line);
+        if (error.column != 0) where += ", column " + std::to_string(error.column);
+        where += ": ";
+    }
+    switch (error.code) {
+    case ParseError::Code::NONE: return where + "OK";
+    case ParseError::Code::OPEN_FAILED: return where + "failed to open file";
+    case ParseError::Code::NO_PUZZLE: return where + "no puzzle found";
+    case ParseError::Code::BAD_VALUE: return where + "invalid value";
+    case ParseError::Code::WRONG_LENGTH: return where + "wrong number of values on the line";
+    case ParseError::Code::TOO_MANY_VALUES: return where + "too many values in the row";
+    case ParseError::Code::TOO_FEW_VALUES: return where + "too few values in the row";
+    case ParseError::Code::INCOMPLETE_PUZZLE: return where + "incomplete puzzle";
+    }
+    return where + "unknown error";
+}
+
+// Hands out the lines of a file or stream without copying them.  A regular file is
+// memory mapped; anything else (stdin, a pipe) is read in large blocks.
+class LineSource {
+
+public:
+
+    LineSource() = default;
+
+    // Not copyable; the lines handed out point into this.
+    LineSource(const LineSource& from) = delete;
+    LineSource& operator=(const LineSource& from) = delete;
+
+    ~LineSource() {
+        close();
+    }
+
+    // Start reading from a file, or from stdin if fn is empty or "-".
+    // Return value:
+    //    true - OK
+    //    false - the file couldn't be opened
+    bool open(const std::string& fn);
+
+    // Start reading from a descriptor that is already open, such as a socket, a block
+    // (initially blockSize bytes) at a time.  The descriptor is left open when done.
+    void attach(const int from, const size_t blockSize = BLOCK_SIZE);
+
+    // Get the next line, without its line ending.  It stays valid until the next call.
+    // Return value:
+    //    true - line is the next line
+    //    false - there are no more lines
+    bool nextLine(std::string_view& line);
+
+    // The number of the last line handed out, counting from one.
+    long lineNumber() const {
+        return lineNum;
+    }
+
+private:
+    static constexpr size_t BLOCK_SIZE = 1 << 20;
+
+    int fd = -1;
+    bool ownsFd = false;
+    void* mapping = nullptr;
+    size_t mappingSize = 0;
+
+    // The text not yet handed out is data[pos] up to data[size].  When streaming,
+    // data points into buffer, and atEnd is set once the stream has been read to the end.
+    const char* data = nullptr;
+    size_t size = 0;
+    size_t pos = 0;
+    std::vector<char> buffer;
+    bool atEnd = true;
+    long lineNum = 0;
+
+    bool fill();
+
+    void close();
+};
+
+inline bool LineSource::open(const std::string& fn) {
+    close();
+    if (fn.empty() || fn == "-") {
+        fd = STDIN_FILENO;
+    }
+    else {
+        fd = ::open(fn.c_str(), O_RDONLY);
+        if (fd < 0) {
+            return false;
+        }
+        ownsFd = true;
+        struct stat info;
+        if (fstat(fd, &info) == 0 && S_ISREG(info.st_mode)) {
+            if (info.st_size == 0) {
+                return true;
+            }
+            void* addr = mmap(nullptr, size_t(info.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+            if (addr != MAP_FAILED) {
+                madvise(addr, size_t(info.st_size), MADV_SEQUENTIAL);
+                mapping = addr;
+                mappingSize = size_t(info.st_size);
+                data = static_cast<const char*>(addr);
+                size = mappingSize;
+                return true;
+            }
+        }
+    }
+    // Not something we can map, so read it a block at a time.
+    buffer.resize(BLOCK_SIZE);
+    atEnd = false;
+    return true;
+}
+
+inline void LineSource::attach(const int from, const size_t blockSize) {
+    close();
+    fd = from;
+    buffer.resize(blockSize);
+    atEnd = false;
+}
+
+inline bool LineSource::nextLine(std::string_view& line) {
+    while (true) {
+        const char* start = data + pos;
+        const char* newline = (pos < size) ? static_cast<const char*>(std::memchr(start, '\n', size - pos)) : nullptr;
+        if (newline == nullptr && !atEnd) {
+            fill();
+            continue;
+        }
+        if (pos == size) {
+            return false;
+        }
+        const char* end = (newline != nullptr) ? newline : data + size;
+        pos = size_t(end - data) + (newline != nullptr ? 1 : 0);
+        if (end != start && end[-1] == '\r') end--;
+        line = std::string_view(start, size_t(end - start));
+        lineNum++;
+        return true;
+    }
+}
+
+// Read another block from the stream, after moving whatever hasn't been handed out
+// yet to the front of the buffer.  The buffer grows if a single line fills it.
+// Return value:
+//    true - more was read
+//    false - the stream is at its end (or failed), and atEnd is set
+inline bool LineSource::fill() {
+    size_t remaining = size - pos;
+    if (remaining != 0 && data + pos != buffer.data()) {
+        std::memmove(buffer.data(), data + pos, remaining);
+    }
+    if (remaining == buffer.size()) {
+        buffer.resize(2 * buffer.size());
+    }
+    data = buffer.data();
+    pos = 0;
+    size = remaining;
+    while (true) {
+        ssize_t got = read(fd, buffer.data() + remaining, buffer.size() - remaining);
+        if (got > 0) {
+            size += size_t(got);
+            return true;
+        }
+        if (got < 0 && errno == EINTR) continue;
+        atEnd = true;
+        return false;
+    }
+}
+
+inline void LineSource::close() {
+    if (mapping != nullptr) {
+        munmap(mapping, mappingSize);
+    }
+    if (ownsFd) {
+        ::close(fd);
+    }
+    fd = -1;
+    ownsFd = false;
+    mapping = nullptr;
+    mappingSize = 0;
+    data = nullptr;
+    size = pos = 0;
+    buffer.clear();
+    atEnd = true;
+    lineNum = 0;
+}
+
+// Decodes puzzles of SIZE x SIZE straight from the lines of a LineSource, one row
+// after another into an array of cells.  Several formats are understood, and can
+// be mixed in one input:
+//    - a single line of SIZE * SIZE values (as written by valueToChar(), with '0' or
+//      '.' for a blank), as in .sdm files.  Anything after the values must be
+//      separated from them by white space.
+//    - SIZE lines of SIZE comma separated numbers, as in the puzzle files.  A space,
+//      empty string or 0 is a blank.
+//    - SIZE lines of SIZE values as in the single line format, as in .sdk files.
+//      Spaces and '|' between values are ignored, as are lines of '-', '+' and '|'
+//      between rows.
+// Blank lines and lines starting with '#' between puzzles are skipped.  A line that
+// fits none of these is reported on its own, and a one line puzzle part way through
+// the rows of another ends that one (as incomplete) rather than being taken as a row,
+// so one bad line doesn't swallow the puzzles after it.
+template <int SIZE>
+class PuzzleReader {
+
+public:
+
+    static constexpr int NUM_SPOTS = SIZE * SIZE;
+
+    explicit PuzzleReader(LineSource& source) : source(source) {}
+
+    // Read the next puzzle into cells.
+    // Return value:
+    //    true - a puzzle was read.  If it was malformed, error says what was wrong
+    //           first and cells should be ignored; otherwise error.ok() is true.
+    //    false - there are no more puzzles.
+    bool next(uint8_t (&cells)[NUM_SPOTS], ParseError& error);
+
+    // The number of the last line read.
+    long lineNumber() const {
+        return source.lineNumber();
+    }
+
+private:
+    LineSource& source;
+
+    // A line read too far: the one line puzzle that ended the last one early.
+    std::string heldLine;
+    bool holding = false;
+
+    static bool isSeparator(const char c) {
+        return c == ' ' || c == '\t' || c == '|';
+    }
+
+    static int countLeadingValues(const std::string_view line);
+
+    static int countValues(const std::string_view line);
+
+    static bool isDecoration(const std::string_view line);
+
+    bool parseValues(const std::string_view line, uint8_t* rowCells, const int count, const bool separators,
+                     ParseError& error) const;
+
+    bool parseCsvRow(const std::string_view line, uint8_t* rowCells, ParseError& error) const;
+
+    void setError(ParseError& error, const ParseError::Code code, const int column) const;
+};
+
+template <int SIZE>
+bool PuzzleReader<SIZE>::next(uint8_t (&cells)[NUM_SPOTS], ParseError& error) {
+    error = ParseError();
+    enum class Format { CSV, ROWS };
+    Format format = Format::ROWS;
+    int row = 0;
+    std::string_view line;
+    while (holding || source.nextLine(line)) {
+        if (holding) {
+            line = heldLine;
+            holding = false;
+        }
+        const bool isCsv = line.find(',') != std::string_view::npos;
+        if (row == 0) {
+            if (line.empty() || line[0] == '#' || isDecoration(line)) continue;
+            if (isCsv) {
+                format = Format::CSV;
+            }
+            else if (countLeadingValues(line) == NUM_SPOTS) {
+                parseValues(line, cells, NUM_SPOTS, false, error);
+                return true;
+            }
+            else if (countLeadingValues(line) > SIZE || countValues(line) != SIZE) {
+                // Neither a puzzle nor a row of one, e.g. a one line puzzle cut short.
+                setError(error, ParseError::Code::WRONG_LENGTH, 0);
+                return true;
+            }
+            else {
+                format = Format::ROWS;
+            }
+        }
+        else if (format == Format::ROWS && isDecoration(line)) {
+            continue;
+        }
+        else if (!isCsv && countLeadingValues(line) == NUM_SPOTS) {
+            // A whole puzzle where a row should be: this puzzle is short of rows, and
+            // the line is read again as the next one.
+            setError(error, ParseError::Code::INCOMPLETE_PUZZLE, 0);
+            heldLine.assign(line);
+            holding = true;
+            return true;
+        }
+
+        // One row of the puzzle.  Keep reading the rest of the puzzle's rows after an
+        // error so they aren't mistaken for the next puzzle.
+        uint8_t* rowCells = cells + SIZE * row;
+        if (format == Format::CSV) parseCsvRow(line, rowCells, error);
+        else parseValues(line, rowCells, SIZE, true, error);
+        if (++row == SIZE) {
+            return true;
+        }
+    }
+    if (row != 0) {
+        if (error.ok()) setError(error, ParseError::Code::INCOMPLETE_PUZZLE, 0);
+        return true;
+    }
+    return false;
+}
+
+// The values up to the first white space, not counting '|'.  More than a row's worth
+// means the whole puzzle is meant to be on the line.
+template <int SIZE>
+int PuzzleReader<SIZE>::countLeadingValues(const std::string_view line) {
+    int count = 0;
+    for (size_t idx=0; idx < line.size() && line[idx] != ' ' && line[idx] != '\t'; idx++) {
+        if (line[idx] != '|') count++;
+    }
+    return count;
+}
+
+// The values on the whole line, not counting separators.
+template <int SIZE>
+int PuzzleReader<SIZE>::countValues(const std::string_view line) {
+    int count = 0;
+    for (char c : line) {
+        if (!isSeparator(c)) count++;
+    }
+    return count;
+}
+
+// Whether the line is only a separator between rows, such as "------+-------+------".
+template <int SIZE>
+bool PuzzleReader<SIZE>::isDecoration(const std::string_view line) {
+    bool sawDash = false;
+    for (char c : line) {
+        if (c == '-' || c == '+' || c == '=') sawDash = true;
+        else if (!isSeparator(c)) return false;
+    }
+    return sawDash;
+}
+
+// Decode count values written as by valueToChar() from the line.  If separators is
+// set, spaces and '|' between them are skipped.
+// Return value:
+//    true - the line was OK
+//    false - it wasn't.  error is set if it was OK before.
+template <int SIZE>
+bool PuzzleReader<SIZE>::parseValues(const std::string_view line, uint8_t* rowCells, const int count,
+                                     const bool separators, ParseError& error) const {
+    int numValues = 0;
+    for (size_t idx=0; idx < line.size(); idx++) {
+        char c = line[idx];
+        if (separators && isSeparator(c)) continue;
+        if (numValues == count) {
+            if (!separators) break; // white space after a one line puzzle
+            setError(error, ParseError::Code::TOO_MANY_VALUES, int(idx) + 1);
+            return false;
+        }
+        int value = (c == '.') ? 0 : charToValue(c);
+        if (value < 0 || value > SIZE) {
+            setError(error, ParseError::Code::BAD_VALUE, int(idx) + 1);
+            return false;
+        }
+        rowCells[numValues++] = uint8_t(value);
+    }
+    if (numValues != count) {
+        setError(error, ParseError::Code::TOO_FEW_VALUES, 0);
+        return false;
+    }
+    return true;
+}
+
+// Decode a line of SIZE comma separated numbers, accepting a space, empty string
+// or 0 as a blank.
+// Return value: as for parseValues()
+template <int SIZE>
+bool PuzzleReader<SIZE>::parseCsvRow(const std::string_view line, uint8_t* rowCells, ParseError& error) const {
+    int col = 0;
+    size_t start = 0;
+    while (true) {
+        size_t end = line.find(',', start);
+        if (end == std::string_view::npos) end = line.size();
+        if (col == SIZE) {
+            setError(error, ParseError::Code::TOO_MANY_VALUES, col + 1);
+            return false;
+        }
+        int number = 0;
+        int numDigits = 0;
+        bool ok = true;
+        for (size_t idx=start; idx < end; idx++) {
+            char c = line[idx];
+            if (c >= '0' && c <= '9') {
+                number = 10 * number + (c - '0');
+                numDigits++;
+            }
+            else if (c != ' ') ok = false;
+        }
+        if (!ok || numDigits > 2 || number > SIZE) {
+            setError(error, ParseError::Code::BAD_VALUE, col + 1);
+            return false;
+        }
+        rowCells[col++] = uint8_t(number);
+        if (end == line.size()) break;
+        start = end + 1;
+    }
+    if (col != SIZE) {
+        setError(error, ParseError::Code::TOO_FEW_VALUES, 0);
+        return false;
+    }
+    return true;
+}
+
+// Record a problem on the current line, unless an earlier one has been recorded.
+template <int SIZE>
+void PuzzleReader<SIZE>::setError(ParseError& error, const ParseError::Code code, const int column) const {
+    if (!error.ok()) return;
+    error.code = code;
+    error.line = source.lineNumber();
+    error.column = column;
+}
+
+// The exact cover form of a puzzle, solved with Knuth's Dancing Links (Algorithm X).
+// Each row of the matrix is one value in one spot, and each column a constraint that
+// exactly one chosen row must meet: every spot has a value, and every row, column and
+// box has each value once.  That is 4 * NUM_SPOTS columns and NUM_SPOTS * SIZE rows
+// (324 and 729 for 9x9), linked as a sparse matrix of four nodes per row.
+//
+// The matrix is the same for every puzzle of a size, so it is built once per thread
+// (see forThisThread()) and each solve covers the givens, searches, then uncovers
+// everything again, leaving it as it was.
+template <int BOX_ROWS, int BOX_COLS>
+class DancingLinks {
+
+    typedef GridShape<BOX_ROWS, BOX_COLS> Shape;
+
+public:
+
+    static constexpr int SIZE = Shape::SIZE;
+    static constexpr int NUM_SPOTS = Shape::NUM_SPOTS;
+    static constexpr int NUM_COLUMNS = 4 * NUM_SPOTS;
+    static constexpr int NUM_ROWS = NUM_SPOTS * SIZE;
+
+    DancingLinks();
+
+    // The matrix for the calling thread, built the first time it is asked for.
+    static DancingLinks& forThisThread();
+
+    // Search for solutions of the puzzle given by board, which must be consistent (no
+    // repeated values), stopping once limit of them have been found.  If solution
+    // isn't null, the first solution found is written to it.  Tracer and stats are
+    // as for BasicSudokuPuzzle; only the search counts are updated.
+    // Return value:
+    //    The number of solutions found, at most limit.
+    template <typename Tracer>
+    long solve(const int (&board)[SIZE][SIZE], const long limit, int (*solution)[SIZE], SolverStats& stats);
+
+private:
+    // A 1 in the matrix, or (the first NUM_COLUMNS + 1 nodes) the header of a column
+    // or of the whole list of columns.  Links are node indices.
+    struct Node {
+        int left;
+        int right;
+        int up;
+        int down;
+        int column;
+        int row;
+    };
+
+    // The list of columns not yet covered starts and ends here.
+    static constexpr int ROOT = 0;
+
+    std::vector<Node> nodes;
+    // The number of uncovered rows in each column, indexed by header node.
+    std::vector<int> columnSize;
+    // The rows chosen at each level of the search.
+    std::vector<int> chosen;
+
+    // What the current solve() is after.
+    long limit = 1;
+    long found = 0;
+    int (*solution)[SIZE] = nullptr;
+    SolverStats* stats = nullptr;
+
+    // The first node of a matrix row.  The four nodes of a row are consecutive.
+    static int firstNode(const int row) {
+        return NUM_COLUMNS + 1 + 4 * row;
+    }
+
+    void cover(const int column);
+
+    void uncover(const int column);
+
+    template <typename Tracer>
+    bool search(const int level, const int depth);
+};
+
+template <int BOX_ROWS, int BOX_COLS>
+DancingLinks<BOX_ROWS, BOX_COLS>::DancingLinks()
+    : nodes(NUM_COLUMNS + 1 + 4 * NUM_ROWS), columnSize(NUM_COLUMNS + 1, 0), chosen(NUM_SPOTS) {
+    // The column headers, in a circular list through ROOT.
+    for (int column=0; column <= NUM_COLUMNS; column++) {
+        nodes[column] = Node{ column - 1, column + 1, column, column, column, -1 };
+    }
+    nodes[ROOT].left = NUM_COLUMNS;
+    nodes[NUM_COLUMNS].right = ROOT;
+
+    // Each row is a value in a spot, numbered (SIZE * row + col) * SIZE + value - 1,
+    // with one node in each of the four constraints it meets, appended to the bottom
+    // of that column.
+    for (int row=0; row < SIZE; row++) {
+        for (int col=0; col < SIZE; col++) {
+            const int spot = SIZE * row + col;
+            const int box = Shape::boxIndex(row, col);
+            for (int value=0; value < SIZE; value++) {
+                const int matrixRow = spot * SIZE + value;
+                const int columns[4] = {
+                    1 + spot,
+                    1 + NUM_SPOTS + SIZE * row + value,
+                    1 + 2 * NUM_SPOTS + SIZE * col + value,
+                    1 + 3 * NUM_SPOTS + SIZE * box + value
+                };
+                const int first = firstNode(matrixRow);
+                for (int idx=0; idx < 4; idx++) {
+                    const int node = first + idx;
+                    const int column = columns[idx];
+                    nodes[node] = Node{ first + (idx + 3) % 4, first + (idx + 1) % 4,
+                                        nodes[column].up, column, column, matrixRow };
+                    nodes[nodes[column].up].down = node;
+                    nodes[column].up = node;
+                    columnSize[column]++;
+                }
+            }
+        }
+    }
+}
+
+template <int BOX_ROWS, int BOX_COLS>
+DancingLinks<BOX_ROWS, BOX_COLS>& DancingLinks<BOX_ROWS, BOX_COLS>::forThisThread() {
+    thread_local DancingLinks matrix;
+    return matrix;
+}
+
+// Take a column out of the list of columns, and every row that meets it out of the
+// other columns that row meets.
+template <int BOX_ROWS, int BOX_COLS>
+void DancingLinks<BOX_ROWS, BOX_COLS>::cover(const int column) {
+    nodes[nodes[column].right].left = nodes[column].left;
+    nodes[nodes[column].left].right = nodes[column].right;
+    for (int row = nodes[column].down; row != column; row = nodes[row].down) {
+        for (int node = nodes[row].right; node != row; node = nodes[node].right) {
+            nodes[nodes[node].down].up = nodes[node].up;
+            nodes[nodes[node].up].down = nodes[node].down;
+            columnSize[nodes[node].column]--;
+        }
+    }
+}
+
+// Undo cover(column).  The nodes taken out still point at their old neighbours, so
+// putting them back in the reverse order restores the links exactly.
+template <int BOX_ROWS, int BOX_COLS>
+void DancingLinks<BOX_ROWS, BOX_COLS>::uncover(const int column) {
+    for (int row = nodes[column].up; row != column; row = nodes[row].up) {
+        for (int node = nodes[row].left; node != row; node = nodes[node].left) {
+            columnSize[nodes[node].column]++;
+            nodes[nodes[node].down].up = node;
+            nodes[nodes[node].up].down = node;
+        }
+    }
+    nodes[nodes[column].right].left = column;
+    nodes[nodes[column].left].right = column;
+}
+
+template <int BOX_ROWS, int BOX_COLS>
+template <typename Tracer>
+long DancingLinks<BOX_ROWS, BOX_COLS>::solve(const int (&board)[SIZE][SIZE], const long limit, int (*solution)[SIZE],
+                                             SolverStats& stats) {
+    this->limit = limit;
+    this->solution = solution;
+    this->stats = &stats;
+    found = 0;
+
+    // Choosing the givens' rows up front leaves only the blank spots to search.
+    int numGivens = 0;
+    for (int row=0; row < SIZE; row++) {
+        for (int col=0; col < SIZE; col++) {
+            if (board[row][col] == 0) continue;
+            const int first = firstNode((SIZE * row + col) * SIZE + board[row][col] - 1);
+            for (int idx=0; idx < 4; idx++) {
+                cover(nodes[first + idx].column);
+            }
+            chosen[numGivens++] = first;
+        }
+    }
+    if (limit > 0) {
+        search<Tracer>(numGivens, 0);
+    }
+    while (numGivens > 0) {
+        const int first = chosen[--numGivens];
+        for (int idx=3; idx >= 0; idx--) {
+            uncover(nodes[first + idx].column);
+        }
+    }
+    this->stats = nullptr;
+    return found;
+}
+
+// Algorithm X: pick the constraint met by the fewest rows, and try each of those rows
+// in turn, covering every other constraint it meets.  level counts the rows chosen
+// so far (givens included), depth the choices that weren't forced.
+// Return value:
+//    true - the last of the solutions wanted was found
+//    false - no (more) solutions from here
+template <int BOX_ROWS, int BOX_COLS>
+template <typename Tracer>
+bool DancingLinks<BOX_ROWS, BOX_COLS>::search(const int level, const int depth) {
+    if (nodes[ROOT].right == ROOT) {
+        if (found++ == 0 && solution != nullptr) {
+            for (int idx=0; idx < level; idx++) {
+                const int matrixRow = nodes[chosen[idx]].row;
+                solution[matrixRow / SIZE / SIZE][matrixRow / SIZE % SIZE] = matrixRow % SIZE + 1;
+            }
+        }
+        return found >= limit;
+    }
+
+    int column = ROOT;
+    int fewest = NUM_ROWS + 1;
+    for (int candidate = nodes[ROOT].right; candidate != ROOT; candidate = nodes[candidate].right) {
+        if (columnSize[candidate] < fewest) {
+            column = candidate;
+            fewest = columnSize[candidate];
+            if (fewest <= 1) break;
+        }
+    }
+    if (fewest == 0) {
+        Tracer::contradiction();
+        return false;
+    }
+
+    const bool guessing = fewest > 1;
+    const int nextDepth = guessing ? depth + 1 : depth;
+    if (nextDepth > stats->maxDepth) stats->maxDepth = nextDepth;
+    cover(column);
+    bool done = false;
+    for (int row = nodes[column].down; row != column && !done; row = nodes[row].down) {
+        const int matrixRow = nodes[row].row;
+        const int spotRow = matrixRow / SIZE / SIZE, spotCol = matrixRow / SIZE % SIZE, value = matrixRow % SIZE + 1;
+        if (guessing) {
+            stats->guesses++;
+            Tracer::tryingValue(spotRow, spotCol, value, nextDepth);
+        }
+        else {
+            Tracer::forcedValue(spotRow, spotCol, value);
+        }
+        chosen[level] = row;
+        for (int node = nodes[row].right; node != row; node = nodes[node].right) {
+            cover(nodes[node].column);
+        }
+        done = search<Tracer>(level + 1, nextDepth);
+        for (int node = nodes[row].left; node != row; node = nodes[node].left) {
+            uncover(nodes[node].column);
+        }
+        if (!done && guessing) {
+            Tracer::backtracking(spotRow, spotCol, value);
+            stats->backtracks++;
+        }
+    }
+    uncover(column);
+    return done;
+}
+
+// A puzzle whose boxes (submatrices) are BOX_ROWS high and BOX_COLS wide, so the
+// board is SIZE x SIZE with SIZE = BOX_ROWS * BOX_COLS.  Every size and loop bound
+// is a compile time constant, so the usual 9x9 puzzle (SudokuPuzzle, below) is as
+// fast as if it were written for that size alone.  The whole search state is held
+// inline, so puzzles much larger than 25x25 are best not kept on the stack.  Tracer
+// (see NoTrace) is told about each step of the search.
+template <int BOX_ROWS, int BOX_COLS, typename Tracer = NoTrace>
+class BasicSudokuPuzzle {
+
+    typedef GridShape<BOX_ROWS, BOX_COLS> Shape;
+
+public:
+
+    // The number of values, and of rows, columns and boxes.
+    static constexpr int SIZE = Shape::SIZE;
+    static constexpr int NUM_SPOTS = Shape::NUM_SPOTS;
+
+    typedef typename Shape::Mask CandidateMask;
+
+    // Constructor taking a 2D array of ints
+    BasicSudokuPuzzle(const int potentialSolution[SIZE][SIZE]);
+
+    // Constructor taking the values of the spots, one row after another, with zero
+    // for a blank.
+    explicit BasicSudokuPuzzle(const uint8_t (&cells)[NUM_SPOTS]);
+
+    // Constructor taking the name of a file holding the puzzle in any of the formats
+    // PuzzleReader understands, such as a CSV file with SIZE lines of ints, SIZE per
+    // line, each line representing a row of the puzzle board.  Only the first puzzle
+    // in the file is used.  If the file can't be read, the board is left blank and,
+    // if error isn't null, *error says why.
+    BasicSudokuPuzzle(const std::string& fn, ParseError* error = nullptr);
+
+    // Copy and move.  All of the state is held inline (no heap allocations), so
+    // the compiler generated member-wise versions are exactly what we want.
+    BasicSudokuPuzzle(const BasicSudokuPuzzle& from) = default;
+    BasicSudokuPuzzle& operator=(const BasicSudokuPuzzle& from) = default;
+    BasicSudokuPuzzle(BasicSudokuPuzzle&& from) = default;
+    BasicSudokuPuzzle& operator=(BasicSudokuPuzzle&& from) = default;
+
+    ~BasicSudokuPuzzle() = default;
+
+    // Check the given puzzle to see if it is a valid solution.  If verbose is set,
+    // each row, column and submatrix checked is reported on stdout; otherwise this is
+    // the same as isConsistent().
+    // Return value:
+    //    true - The puzzle contains a valid solution.
+    //    false - The puzzle does NOT contain a valid solution.
+    bool isSolutionValid(const bool verbose = false) const;
+
+    // Whether every value on the board is 0 - SIZE and none is repeated within a row,
+    // column or submatrix.  Kept up to date as values are set, so no scan is needed.
+    bool isConsistent() const;
+
+    // Whether the board is full and consistent, i.e. solved.  Also constant time.
+    bool isComplete() const;
+
+    // The number of repeats on the board: for each row, column and submatrix, the
+    // copies of each value beyond the first.
+    int getConflictCount() const;
+
+    // Solve an incomplete puzzle.  Nothing is printed; use print() to show the
+    // solution, or a Tracer such as ConsoleTrace to follow the search.
+    // Return value:
+    //    true - puzzle was solved
+    //    false - puzzle was not solved.  Either there is no valid solution or
+    //            the algorithm is insufficient (defective).
+    bool solve();
+
+    // Solve an incomplete puzzle and copy the solution, one row after another, into
+    // solution.  Like solve(), nothing is printed; unlike it, a puzzle whose givens
+    // clash is told apart from one with no solution.
+    // Return value: see SolveStatus.  solution is only written when SOLVED.
+    SolveStatus solveInto(uint8_t (&solution)[NUM_SPOTS]);
+
+    // Solve an incomplete puzzle using several threads.  The first few levels of
+    // guesses are split into separate tasks, which are shared out among the threads;
+    // a thread that runs out of tasks takes some from another.  Worth it only for
+    // puzzles that take a lot of guessing.  With the DANCING_LINKS backend, the
+    // search isn't split up; this is the same as solve().
+    //    numThreads - zero for one per hardware thread
+    //    mode - whether the solution must match the one solve() finds
+    // Return value: as for solve()
+    bool solveParallel(const unsigned numThreads = 0, const ParallelMode mode = ParallelMode::DETERMINISTIC);
+
+    // Count the solutions of an incomplete puzzle, stopping as soon as limit of them
+    // have been found.  countSolutions(2) is a quick way to check that a puzzle has
+    // exactly one solution.  The board is left as it was.
+    // Return value:
+    //    The number of solutions found, at most limit.
+    long countSolutions(const long limit);
+
+    // Like countSolutions(), but found is called with the puzzle as each solution is
+    // reached, to read with getValue() or getCells().  Always searches with
+    // PROPAGATION, whatever the backend.  The board is left as it was.
+    // Return value:
+    //    The number of solutions found, at most limit.
+    long forEachSolution(const long limit, const std::function<void(const BasicSudokuPuzzle&)>& found);
+
+    // Split the search into parts that can be counted or enumerated independently,
+    // e.g. on different machines or over several runs: search as solve() would, but
+    // stop levels guesses down and add the board at that point (the givens, the
+    // guesses and everything they forced; NUM_SPOTS values row by row, zero for blank)
+    // to parts, then carry on with the next guess.  Every solution of the puzzle is a
+    // solution of exactly one part.  The parts come out in the same order each time
+    // for the same puzzle, levels and search policy.  The board is left as it was.
+    // Return value:
+    //    true - OK; parts holds the boards back to back (none if there's no solution)
+    //    false - the givens clash
+    bool partitionSearch(const int levels, std::vector<uint8_t>& parts);
+
+    // Get the value of specified location on the board.  Zero based indexing.
+    int getValue(const int row, const int col) const;
+
+    // Copy the values of the spots, one row after another, with zero for a blank.
+    void getCells(uint8_t (&cells)[NUM_SPOTS]) const;
+
+    // Set the value of the specified location on the board to the specified value.
+    // Takes constant time, including keeping track of the repeats it makes or clears.
+    void setValue(const int row, const int col, const int value);
+
+    // Choose which of the DeductionRule values solve() uses, combined with |.  Each
+    // rule costs time at every step of the search but may save guesses.
+    void setRules(const unsigned rules);
+
+    // The DeductionRule values solve() uses.
+    unsigned getRules() const;
+
+    // Choose the algorithm solve() and countSolutions() use.  The deduction rules only
+    // apply to PROPAGATION, the default.
+    void setBackend(const SolverBackend backend);
+
+    // The algorithm solve() and countSolutions() use.
+    SolverBackend getBackend() const;
+
+    // Choose where the search guesses and in what order it tries the choices.  Only
+    // applies to PROPAGATION.  Changes the number of guesses, and with it the speed,
+    // but not the number of solutions; which one solve() finds first may differ.
+    void setSearchPolicy(const SearchPolicy& policy);
+
+    // How the search guesses.
+    const SearchPolicy& getSearchPolicy() const;
+
+    // What the last solve(), solveParallel() or countSolutions() did.  For
+    // solveParallel(), the counts are summed over the threads, except for the guesses
+    // made splitting up the search, and the times are as seen by the caller.
+    const SolverStats& getStats() const;
+
+    // Print the contents of the puzzle to stdout.
+    void print() const;
+
+    // Print the possibilities of each blank spot to stdout.  Only meaningful during
+    // a search, so mostly of use to a Tracer.
+    void listPossibilities() const;
+
+private:
+    static constexpr int NUM_UNITS = Shape::NUM_UNITS;
+    static constexpr CandidateMask ALL_CANDIDATES = Shape::ALL_CANDIDATES;
+
+    static constexpr PeerTable<BOX_ROWS, BOX_COLS> PEERS{};
+    static constexpr UnitTable<BOX_ROWS, BOX_COLS> UNITS{};
+
+    // One change made to the puzzle while searching for a solution: the spot that
+    // changed, and its possibilities before the change.  If the spot has a value on
+    // the board when the entry is undone, the change was setting that value.
+    struct TrailEntry {
+        uint8_t row;
+        uint8_t col;
+        CandidateMask oldPossibilities;
+    };
+
+    // Along any one path through the search, a blank spot can lose possibilities at
+    // most SIZE - 1 times before it has its value set, so this many entries is
+    // always enough.
+    static constexpr int TRAIL_CAPACITY = NUM_SPOTS * SIZE;
+
+    // A deduction rule as used by solve(): its DeductionRule bit, a name for
+    // tracing, and the method that applies it.
+    struct RuleEntry {
+        DeductionRule rule;
+        const char* name;
+        int (BasicSudokuPuzzle::*apply)();
+    };
+
+    // All of the deduction rules, cheapest first.
+    static const RuleEntry RULE_TABLE[6];
+
+    int board[SIZE][SIZE];
+
+    // For each blank spot on the board, the set of valid values for the current state of the
+    // puzzle.  Zero for each spot that already has its value set (non-zero).
+    CandidateMask possibilities[SIZE][SIZE];
+
+    // The values already placed in each row, column and submatrix.  Kept up to
+    // date as values are set, so checking whether a value would fit in a spot is
+    // a single AND of the three masks.
+    CandidateMask rowUsed[SIZE];
+    CandidateMask colUsed[SIZE];
+    CandidateMask boxUsed[SIZE];
+
+    // For each row, column and submatrix, how many more times than once each value
+    // (1 - SIZE, indexed from zero) is on the board.  Always zero while searching, as
+    // the board is consistent then, so only setValue() and countValues() touch them.
+    uint8_t rowRepeats[SIZE][SIZE];
+    uint8_t colRepeats[SIZE][SIZE];
+    uint8_t boxRepeats[SIZE][SIZE];
+
+    // The sum of all the repeats, and the number of values outside 0 - SIZE.
+    int numConflicts = 0;
+    int numBadValues = 0;
+
+    // One choice of a guess: value in the spot at row, col.
+    struct Guess {
+        uint8_t row;
+        uint8_t col;
+        uint8_t value;
+    };
+
+    // Every change made by solve(), most recent last, so that a guess that doesn't
+    // work out can be undone in place.
+    TrailEntry trail[TRAIL_CAPACITY];
+    int trailSize = 0;
+
+    // Blank spots that are down to a single possibility and still need their value
+    // set.  Each spot is added at most once (when it goes from two possibilities to
+    // one), so an entry per spot is enough.
+    Spot pending[NUM_SPOTS];
+    int numPending = 0;
+
+    // Number of blank spots on the board.
+    int numBlank = 0;
+
+    // The DeductionRule values used by solve().
+    unsigned rules = HIDDEN_SINGLES;
+
+    SolverBackend backend = SolverBackend::PROPAGATION;
+
+    SearchPolicy policy;
+
+    // Set while solveParallel() runs a task, so the search can give up once another
+    // thread has found the solution that will be used: the search stops when the
+    // shared value drops below searchIndex.
+    const std::atomic<size_t>* abortBelow = nullptr;
+    size_t searchIndex = 0;
+
+    // How many solutions the search should find before it stops, and how many it has.
+    // solve() wants just one and keeps it on the board; countSolutions() keeps going.
+    long solutionsWanted = 1;
+    long solutionsFound = 0;
+    // Called as each solution is reached, if set; see forEachSolution().
+    const std::function<void(const BasicSudokuPuzzle&)>* solutionFound = nullptr;
+
+    SolverStats stats;
+
+    // The number of guesses in effect at the current point of the search.
+    int depth = 0;
+
+    bool isRowOrColOk(const int row, const RowOrCol which = RowOrCol::ROW) const;
+
+    bool isSubmatrixOk(const int startRowIdx, const int startColIdx) const;
+
+    bool areSubmatricesOk() const;
+
+    void countValues();
+
+    void addUse(const int row, const int col, const int value);
+
+    void removeUse(const int row, const int col, const int value);
+
+    void placeValue(const int row, const int col, const int value);
+
+    bool assignValue(const int row, const int col, const int value);
+
+    void narrowPossibilities(const int row, const int col, const CandidateMask mask);
+
+    bool removePossibilities(const int row, const int col, const CandidateMask mask);
+
+    bool eliminate(const int row, const int col, const CandidateMask mask);
+
+    void findPlaces(const int unit, CandidateMask (&places)[SIZE]) const;
+
+    int removeFromUnit(const int unit, const CandidateMask keepPositions, const CandidateMask values);
+
+    int applyRules();
+
+    int findHiddenSingles();
+
+    int findNakedPairs();
+
+    int findNakedTriples();
+
+    int findNakedSubsets(const int size);
+
+    int findHiddenPairs();
+
+    int findHiddenTriples();
+
+    int findHiddenSubsets(const int size);
+
+    int findBoxLineReductions();
+
+    void undoTo(const int mark);
+
+    bool setAllPossibilities();
+
+    int propagate();
+
+    int chooseBranch(Guess (&guesses)[SIZE]) const;
+
+    void countPlaces(uint8_t (&places)[NUM_UNITS][SIZE]) const;
+
+    int countBlankPeers(const int row, const int col) const;
+
+    int peersWithValue(const int row, const int col, const int value) const;
+
+    bool prepareToSolve();
+
+    long solveExactCover(const long limit, const bool keepSolution);
+
+    int deduce();
+
+    bool search();
+
+    template <typename Visit>
+    void splitSearch(const int levels, Visit& visit);
+
+    void loadCells(const uint8_t* cells);
+
+    // The mask with just bit idx set.
+    static CandidateMask maskBit(const int idx) {
+        return CandidateMask(CandidateMask(1) << idx);
+    }
+
+    // The bit representing the given value (1 - SIZE) in a CandidateMask.
+    static CandidateMask candidateBit(const int value) {
+        return maskBit(value - 1);
+    }
+
+    // The index of the box containing the given spot.
+    static constexpr int boxIndex(const int row, const int col) {
+        return Shape::boxIndex(row, col);
+    }
+
+    // The count positions of a unit (as listed in UNITS) starting at first.
+    static constexpr CandidateMask runPositions(const int first, const int count) {
+        return CandidateMask((CandidateMask(Shape::ALL_CANDIDATES) >> (SIZE - count)) << first);
+    }
+
+    // The positions within a box unit of one of its rows, and of one of its columns.
+    static constexpr CandidateMask boxRowPositions(const int boxRow) {
+        return runPositions(BOX_COLS * boxRow, BOX_COLS);
+    }
+
+    static constexpr CandidateMask boxColPositions(const int boxCol) {
+        CandidateMask positions = 0;
+        for (int boxRow=0; boxRow < BOX_ROWS; boxRow++) {
+            positions |= CandidateMask(CandidateMask(1) << (BOX_COLS * boxRow + boxCol));
+        }
+        return positions;
+    }
+
+};
+
+// The standard 9x9 puzzle.
+typedef BasicSudokuPuzzle<3, 3> SudokuPuzzle;
+
+template <int BOX_ROWS, int BOX_COLS, typename Tracer>
+BasicSudokuPuzzle<BOX_ROWS, BOX_COLS, Tracer>::BasicSudokuPuzzle(const int potentialSolution[SIZE][SIZE]) {
+    // Set the values of the board
+    for (int row=0; row < SIZE; row++) {
+        for (int col=0; col < SIZE; col++) {
+            board[row][col] = potentialSolution[row][col];
+        }
+    }
+
+    // Initialize possibilities to empty
+    for (int row=0; row < SIZE; row++) {
+        for (int col=0; col < SIZE; col++) {
+            possibilities[row][col] = 0;
+        }
+    }
+
+    countValues();
+}
+
+template <int BOX_ROWS, int BOX_COLS, typename Tracer>
+BasicSudokuPuzzle<BOX_ROWS, BOX_COLS, Tracer>::BasicSudokuPuzzle(const uint8_t (&cells)[NUM_SPOTS]) {
+    loadCells(cells);
+}
+
+template <int BOX_ROWS, int BOX_COLS, typename Tracer>
+BasicSudokuPuzzle<BOX_ROWS, BOX_COLS, Tracer>::BasicSudokuPuzzle(const std::string &fn, ParseError* error) {
+    uint8_t cells[NUM_SPOTS];
+    ParseError parseError;
+    LineSource source;
+    if (!source.open(fn)) {
+        parseError.code = ParseError::Code::OPEN_FAILED;
+    }
+    else {
+        PuzzleReader<SIZE> reader(source);
+        if (!reader.next(cells, parseError)) {
+            parseError.code = ParseError::Code::NO_PUZZLE;
+        }
+    }
+    if (!parseError.ok()) {
+        for (uint8_t& cell : cells) cell = 0;
+    }
+    if (error != nullptr) *error = parseError;
+    loadCells(cells);
+}
+
+// Set up the puzzle with the given values of the spots, one row after another.
+template <int BOX_ROWS, int BOX_COLS, typename Tracer>
+void BasicSudokuPuzzle<BOX_ROWS, BOX_COLS, Tracer>::loadCells(const uint8_t* cells) {
+    for (int row=0; row < SIZE; row++) {
+        for (int col=0; col < SIZE; col++) {
+            board[row][col] = cells[SIZE * row + col];
+            possibilities[row][col] = 0;
+        }
+    }
+
+    countValues();
+}
+
+template <int BOX_ROWS, int BOX_COLS, typename Tracer>
+bool BasicSudokuPuzzle<BOX_ROWS, BOX_COLS, Tracer>::solve() {
+    if (backend == SolverBackend::DANCING_LINKS) {
+        return solveExactCover(1, true) == 1;
+    }
+    solutionsWanted = 1;
+    solutionsFound = 0;
+    if (!prepareToSolve()) {
+        undoTo(0);
+        return false;
+    }
+    auto start = std::chrono::steady_clock::now();
+    bool solved = search();
+    stats.searchTime = std::chrono::steady_clock::now() - start;
+    if (!solved) {
+        // Put the board back the way it was given to us.
+        undoTo(0);
+    }
+    return solved;
+}
+
+template <int BOX_ROWS, int BOX_COLS, typename Tracer>
+SolveStatus BasicSudokuPuzzle<BOX_ROWS, BOX_COLS, Tracer>::solveInto(uint8_t (&solution)[NUM_SPOTS]) {
+    if (!isConsistent()) {
+        stats = SolverStats();
+        return SolveStatus::INVALID;
+    }
+    if (!solve()) {
+        return SolveStatus::UNSOLVABLE;
+    }
+    getCells(solution);
+    return SolveStatus::SOLVED;
+}
+
+// Get ready to search for a solution, starting the stats afresh.
+// Return value:
+//    true - OK so far
+//    false - the puzzle as given can't be solved
+template <int BOX_ROWS, int BOX_COLS, typename Tracer>
+bool BasicSudokuPuzzle<BOX_ROWS, BOX_COLS, Tracer>::prepareToSolve() {
+    // The candidate checks only look at the used masks, which can't represent a value
+    // that is already repeated, so make sure the starting board is consistent.
+    auto start = std::chrono::steady_clock::now();
+    stats = SolverStats();
+    depth = 0;
+    trailSize = 0;
+    // Work out the possible values for each blank space from the values already on
+    // the board.  From then on, possibilities are only trimmed as values get set.
+    bool ok = isSolutionValid() && setAllPossibilities();
+    stats.setupTime = std::chrono::steady_clock::now() - start;
+    return ok;
+}
+
+template <int BOX_ROWS, int BOX_COLS, typename Tracer>
+bool BasicSudokuPuzzle<BOX_ROWS, BOX_COLS, Tracer>::solveParallel(const unsigned numThreads, const ParallelMode mode) {
+    if (backend == SolverBackend::DANCING_LINKS) {
+        return solve();
+    }
+    solutionsWanted = 1;
+    solutionsFound = 0;
+    if (!prepareToSolve()) {
+        undoTo(0);
+        return false;
+    }
+    auto start = std::chrono::steady_clock::now();
+
+    unsigned threadCount = numThreads != 0 ? numThreads : std::thread::hardware_concurrency();
+    if (threadCount == 0) threadCount = 1;
+
+    // Split the search tree a few guesses down, going deeper until there are enough
+    // tasks to keep every thread busy even if some turn out to be quick.  The tasks
+    // are in the order solve() would get to them.
+    std::vector<BasicSudokuPuzzle> tasks;
+    for (int levels=1; levels <= 4; levels++) {
+        if (levels > 1) {
+            // Undoing doesn't restore the pending list setAllPossibilities() built, so
+            // start over from the given board.
+            undoTo(0);
+            setAllPossibilities();
+        }
+        tasks.clear();
+        auto addTask = [&](const BasicSudokuPuzzle& task) { tasks.push_back(task); };
+        splitSearch(levels, addTask);
+        if (tasks.size() >= 4 * size_t(threadCount)) break;
+    }
+    undoTo(0);
+    if (tasks.empty()) {
+        return false;
+    }
+
+    // Each thread starts with every threadCount-th task, works through its own from the
+    // front, and when they're gone steals from the back of another thread's.
+    struct TaskQueue {
+        std::mutex lock;
+        std::deque<size_t> indices;
+    };
+    std::vector<TaskQueue> queues(threadCount);
+    for (size_t idx=0; idx < tasks.size(); idx++) {
+        queues[idx % threadCount].indices.push_back(idx);
+    }
+
+    // The index of the best task to have found a solution so far.  In FAST mode, any
+    // solution stops every thread; tasks then search with index 1 and this drops to 0.
+    std::atomic<size_t> solvedIndex{SIZE_MAX};
+    std::mutex solutionLock;
+    size_t bestIndex = SIZE_MAX;
+
+    auto worker = [&](const unsigned self) {
+        while (true) {
+            size_t idx = SIZE_MAX;
+            for (unsigned offset=0; offset < threadCount && idx == SIZE_MAX; offset++) {
+                TaskQueue& queue = queues[(self + offset) % threadCount];
+                std::lock_guard<std::mutex> guard(queue.lock);
+                if (queue.indices.empty()) continue;
+                if (offset == 0) {
+                    idx = queue.indices.front();
+                    queue.indices.pop_front();
+                }
+                else {
+                    idx = queue.indices.back();
+                    queue.indices.pop_back();
+                }
+            }
+            if (idx == SIZE_MAX) return;
+            if (solvedIndex.load(std::memory_order_relaxed) < (mode == ParallelMode::FAST ? 1 : idx)) continue;
+
+            BasicSudokuPuzzle& task = tasks[idx];
+            task.stats = SolverStats();
+            task.stats.maxDepth = task.depth;
+            task.abortBelow = &solvedIndex;
+            task.searchIndex = (mode == ParallelMode::FAST) ? 1 : idx;
+            if (task.search()) {
+                std::lock_guard<std::mutex> guard(solutionLock);
+                if (idx < bestIndex || (mode == ParallelMode::FAST && bestIndex == SIZE_MAX)) {
+                    bestIndex = idx;
+                }
+                size_t stopAt = (mode == ParallelMode::FAST) ? 0 : bestIndex;
+                size_t current = solvedIndex.load();
+                while (stopAt < current && !solvedIndex.compare_exchange_weak(current, stopAt)) {}
+            }
+        }
+    };
+
+    std::vector<std::thread> threads;
+    for (unsigned self=1; self < threadCount; self++) {
+        threads.emplace_back(worker, self);
+    }
+    worker(0);
+    for (std::thread& t : threads) {
+        t.join();
+    }
+
+    // Add up what every task did.  What was done splitting up the search isn't
+    // counted, as the split may have been done more than once.
+    SolverStats totals;
+    totals.setupTime = stats.setupTime;
+    totals.searchTime = std::chrono::steady_clock::now() - start;
+    for (const BasicSudokuPuzzle& task : tasks) {
+        totals.propagationPasses += task.stats.propagationPasses;
+        totals.ruleSuccesses += task.stats.ruleSuccesses;
+        totals.candidatesEliminated += task.stats.candidatesEliminated;
+        totals.guesses += task.stats.guesses;
+        totals.backtracks += task.stats.backtracks;
+        totals.maxDepth = std::max(totals.maxDepth, task.stats.maxDepth);
+    }
+    stats = totals;
+    if (bestIndex == SIZE_MAX) {
+        return false;
+    }
+    // Take on the solution, but not the other thread's search settings.
+    *this = tasks[bestIndex];
+    abortBelow = nullptr;
+    searchIndex = 0;
+    stats = totals;
+    return true;
+}
+
+template <int BOX_ROWS, int BOX_COLS, typename Tracer>
+long BasicSudokuPuzzle<BOX_ROWS, BOX_COLS, Tracer>::countSolutions(const long limit) {
+    if (limit <= 0) {
+        return 0;
+    }
+    if (backend == SolverBackend::DANCING_LINKS) {
+        return solveExactCover(limit, false);
+    }
+    solutionsWanted = limit;
+    solutionsFound = 0;
+    if (prepareToSolve()) {
+        auto start = std::chrono::steady_clock::now();
+        search();
+        stats.searchTime = std::chrono::steady_clock::now() - start;
+    }
+    // Put the board back the way it was given to us.
+    undoTo(0);
+    solutionsWanted = 1;
+    return solutionsFound;
+}
+
+template <int BOX_ROWS, int BOX_COLS, typename Tracer>
+long BasicSudokuPuzzle<BOX_ROWS, BOX_COLS, Tracer>::forEachSolution(const long limit,
+                                                                     const std::function<void(const BasicSudokuPuzzle&)>& found) {
+    if (limit <= 0) {
+        return 0;
+    }
+    solutionsWanted = limit;
+    solutionsFound = 0;
+    solutionFound = &found;
+    if (prepareToSolve()) {
+        auto start = std::chrono::steady_clock::now();
+        search();
+        stats.searchTime = std::chrono::steady_clock::now() - start;
+    }
+    undoTo(0);
+    solutionFound = nullptr;
+    solutionsWanted = 1;
+    return solutionsFound;
+}
+
+template <int BOX_ROWS, int BOX_COLS, typename Tracer>
+bool BasicSudokuPuzzle<BOX_ROWS, BOX_COLS, Tracer>::partitionSearch(const int levels, std::vector<uint8_t>& parts) {
+    parts.clear();
+    if (!prepareToSolve()) {
+        undoTo(0);
+        return false;
+    }
+    auto addPart = [&](const BasicSudokuPuzzle& part) {
+        uint8_t cells[NUM_SPOTS];
+        part.getCells(cells);
+        parts.insert(parts.end(), cells, cells + NUM_SPOTS);
+    };
+    splitSearch(std::max(levels, 1), addPart);
+    undoTo(0);
+    return true;
+}
+
+// solve() and countSolutions() for the DANCING_LINKS backend.  If keepSolution is
+// set, the first solution found is left on the board.
+// Return value:
+//    The number of solutions found, at most limit.
+template <int BOX_ROWS, int BOX_COLS, typename Tracer>
+long BasicSudokuPuzzle<BOX_ROWS, BOX_COLS, Tracer>::solveExactCover(const long limit, const bool keepSolution) {
+    auto start = std::chrono::steady_clock::now();
+    stats = SolverStats();
+    // Covering the givens assumes no two of them clash.
+    bool ok = isSolutionValid();
+    DancingLinks<BOX_ROWS, BOX_COLS>& matrix = DancingLinks<BOX_ROWS, BOX_COLS>::forThisThread();
+    stats.setupTime = std::chrono::steady_clock::now() - start;
+    if (!ok) {
+        return 0;
+    }
+
+    start = std::chrono::steady_clock::now();
+    long count = matrix.template solve<Tracer>(board, limit, keepSolution ? board : nullptr, stats);
+    stats.searchTime = std::chrono::steady_clock::now() - start;
+    if (keepSolution && count > 0) {
+        countValues();
+    }
+    return count;
+}
+
+// Split the search for solveParallel() and partitionSearch(): search as solve() would,
+// but stop levels guesses down and pass the puzzle at that point to visit, then undo
+// and carry on with the next guess.  Branches that fail or are solved before reaching
+// that depth contribute nothing or a finished puzzle respectively.
+template <int BOX_ROWS, int BOX_COLS, typename Tracer>
+template <typename Visit>
+void BasicSudokuPuzzle<BOX_ROWS, BOX_COLS, Tracer>::splitSearch(const int levels, Visit& visit) {
+    int blanksLeft = deduce();
+    if (blanksLeft == -1) {
+        return;
+    }
+    if (blanksLeft == 0) {
+        visit(*this);
+        return;
+    }
+    Guess guesses[SIZE];
+    const int numGuesses = chooseBranch(guesses);
+    const int mark = trailSize;
+    for (int idx=0; idx < numGuesses; idx++) {
+        depth++;
+        if (assignValue(guesses[idx].row, guesses[idx].col, guesses[idx].value)) {
+            if (levels == 1) {
+                visit(*this);
+            }
+            else {
+                splitSearch(levels - 1, visit);
+            }
+        }
+        depth--;
+        undoTo(mark);
+    }
+}
+
+// Set every spot that is forced, then try the deduction rules.  Any progress they
+// make may force more spots, so keep going until neither finds anything.
+// Return value:
+//    The number of spots that are still blank, or -1 if the puzzle can't be solved
+//    from here.
+template <int BOX_ROWS, int BOX_COLS, typename Tracer>
+int BasicSudokuPuzzle<BOX_ROWS, BOX_COLS, Tracer>::deduce() {
+    while (true) {
+        int blanksLeft = propagate();
+        if (blanksLeft <= 0) {
+            return blanksLeft;
+        }
+        int rc = applyRules();
+        if (rc == 0) {
+            return blanksLeft;
+        }
+        if (rc == -1) {
+            return -1;
+        }
+    }
+}
+
+// Solve the puzzle from its current state, setting every spot that is forced until no
+// more progress is made, then guessing each possibility for the spot with the fewest
+// and searching on from there.  Every change is recorded on the trail, and a guess
+// that doesn't work out is undone before trying the next one, so the whole search
+// happens in this one puzzle.  Each solution reached is counted in solutionsFound,
+// and the search carries on until solutionsWanted of them have been found.
+// Return value:
+//    true - the last of the solutions wanted was found; the board is filled in
+//    false - no (more) solutions from this state.  The changes made are left on the
+//            trail for the caller to undo.
+template <int BOX_ROWS, int BOX_COLS, typename Tracer>
+bool BasicSudokuPuzzle<BOX_ROWS, BOX_COLS, Tracer>::search() {
+    // When solving in parallel, give up if another thread has already found the
+    // solution that will be used.
+    if (abortBelow != nullptr && abortBelow->load(std::memory_order_relaxed) < searchIndex) {
+        return false;
+    }
+    int blanksLeft = deduce();
+    // Check for a return of -1, which indicates the puzzle can't be solved.
+    if (blanksLeft == -1) {
+        return false;  // Puzzle can't be solved.
+    }
+    // Check for the puzzle now being solved (no blanks left)
+    if (blanksLeft == 0) {
+        if (solutionFound != nullptr) (*solutionFound)(*this);
+        return ++solutionsFound >= solutionsWanted;
+    }
+
+    // Nothing else is forced, so we have to guess.  The search policy says where, and
+    // in what order to try the choices.
+    Guess guesses[SIZE];
+    const int numGuesses = chooseBranch(guesses);
+    if (numGuesses == 0) {
+        return false;
+    }
+    Tracer::guessing(*this, guesses[0].row, guesses[0].col, numGuesses);
+    const int mark = trailSize;
+
+    // Make each choice in turn and try to solve from there (recursive call).
+    for (int idx=0; idx < numGuesses; idx++) {
+        const int row = guesses[idx].row;
+        const int col = guesses[idx].col;
+        const int value = guesses[idx].value;
+        stats.guesses++;
+        if (++depth > stats.maxDepth) stats.maxDepth = depth;
+        Tracer::tryingValue(row, col, value, depth);
+
+        if (assignValue(row, col, value) && search()) {
+            return true;
+        }
+        // That value didn't work out.  Undo everything it led to and try the next one.
+        Tracer::backtracking(row, col, value);
+        stats.backtracks++;
+        depth--;
+        undoTo(mark);
+    }
+    // If survive loop without a solution, return false
+    return false; // stuck
+}
+
+template <int BOX_ROWS, int BOX_COLS, typename Tracer>
+int BasicSudokuPuzzle<BOX_ROWS, BOX_COLS, Tracer>::getValue(const int row, const int col) const {
+    return board[row][col];
+}
+
+template <int BOX_ROWS, int BOX_COLS, typename Tracer>
+void BasicSudokuPuzzle<BOX_ROWS, BOX_COLS, Tracer>::getCells(uint8_t (&cells)[NUM_SPOTS]) const {
+    for (int row=0; row < SIZE; row++) {
+        for (int col=0; col < SIZE; col++) {
+            cells[SIZE * row + col] = uint8_t(board[row][col]);
+        }
+    }
+}
+
+template <int BOX_ROWS, int BOX_COLS, typename Tracer>
+void BasicSudokuPuzzle<BOX_ROWS, BOX_COLS, Tracer>::setValue(const int row, const int col, const int value) {
+    const int oldValue = board[row][col];
+    if (oldValue == value) return;
+    if (oldValue == 0) numBlank--;
+    else if (oldValue >= 1 && oldValue <= SIZE) removeUse(row, col, oldValue);
+    else numBadValues--;
+
+    board[row][col] = value;
+    if (value == 0) numBlank++;
+    else if (value >= 1 && value <= SIZE) addUse(row, col, value);
+    else numBadValues++;
+}
+
+// Count one more use of a value (1 - SIZE) in the row, column and submatrix of a
+// spot.  If a unit already has the value, that's a repeat; otherwise the value is
+// now used there.
+template <int BOX_ROWS, int BOX_COLS, typename Tracer>
+void BasicSudokuPuzzle<BOX_ROWS, BOX_COLS, Tracer>::addUse(const int row, const int col, const int value) {
+    const CandidateMask bit = candidateBit(value);
+    const int box = boxIndex(row, col);
+    if (rowUsed[row] & bit) {
+        rowRepeats[row][value - 1]++;
+        numConflicts++;
+    }
+    else {
+        rowUsed[row] |= bit;
+    }
+    if (colUsed[col] & bit) {
+        colRepeats[col][value - 1]++;
+        numConflicts++;
+    }
+    else {
+        colUsed[col] |= bit;
+    }
+    if (boxUsed[box] & bit) {
+        boxRepeats[box][value - 1]++;
+        numConflicts++;
+    }
+    else {
+        boxUsed[box] |= bit;
+    }
+}
+
+// Count one less use of a value (1 - SIZE) in the row, column and submatrix of a
+// spot: the reverse of addUse().
+template <int BOX_ROWS, int BOX_COLS, typename Tracer>
+void BasicSudokuPuzzle<BOX_ROWS, BOX_COLS, Tracer>::removeUse(const int row, const int col, const int value) {
+    const CandidateMask bit = candidateBit(value);
+    const int box = boxIndex(row, col);
+    if (rowRepeats[row][value - 1] > 0) {
+        rowRepeats[row][value - 1]--;
+        numConflicts--;
+    }
+    else {
+        rowUsed[row] &= ~bit;
+    }
+    if (colRepeats[col][value - 1] > 0) {
+        colRepeats[col][value - 1]--;
+        numConflicts--;
+    }
+    else {
+        colUsed[col] &= ~bit;
+    }
+    if (boxRepeats[box][value - 1] > 0) {
+        boxRepeats[box][value - 1]--;
+        numConflicts--;
+    }
+    else {
+        boxUsed[box] &= ~bit;
+    }
+}
+
+// Put a value in a blank spot and mark it as used in the spot's row, column and
+// submatrix.
+template <int BOX_ROWS, int BOX_COLS, typename Tracer>
+void BasicSudokuPuzzle<BOX_ROWS, BOX_COLS, Tracer>::placeValue(const int row, const int col, const int value) {
+    board[row][col] = value;
+    if (value >= 1 && value <= SIZE) {
+        CandidateMask bit = candidateBit(value);
+        rowUsed[row] |= bit;
+        colUsed[col] |= bit;
+        boxUsed[boxIndex(row, col)] |= bit;
+    }
+}
+
+// Set the value of a blank spot as part of the search, recording it on the trail,
+// and remove the value from the possibilities of the spot's peers.  Any peer left
+// with a single possibility is added to the pending list for propagate().
+// Return value:
+//    true - OK so far
+//    false - a peer was left with no possibilities, so the puzzle can't be solved
+//            from here.  The pending list is cleared.
+template <int BOX_ROWS, int BOX_COLS, typename Tracer>
+bool BasicSudokuPuzzle<BOX_ROWS, BOX_COLS, Tracer>::assignValue(const int row, const int col, const int value) {
+    trail[trailSize++] = TrailEntry{ uint8_t(row), uint8_t(col), possibilities[row][col] };
+    placeValue(row, col, value);
+    possibilities[row][col] = 0;
+    numBlank--;
+
+    // Each peer that loses the value adds one entry to the trail, so count them all
+    // at the end rather than one at a time.
+    const int mark = trailSize;
+    CandidateMask bit = candidateBit(value);
+    bool ok = true;
+    for (const Spot& peer : PEERS.peers[row][col]) {
+        if (!removePossibilities(peer.row, peer.col, bit)) {
+            ok = false;
+            break;
+        }
+    }
+    stats.candidatesEliminated += trailSize - mark;
+    return ok;
+}
+
+// Replace the possibilities of a blank spot with a smaller set, recording the
+// change on the trail.
+template <int BOX_ROWS, int BOX_COLS, typename Tracer>
+void BasicSudokuPuzzle<BOX_ROWS, BOX_COLS, Tracer>::narrowPossibilities(const int row, const int col, const CandidateMask mask) {
+    trail[trailSize++] = TrailEntry{ uint8_t(row), uint8_t(col), possibilities[row][col] };
+    possibilities[row][col] = mask;
+}
+
+// Remove any of the given values from the possibilities of a spot, recording the
+// change on the trail.  A spot left with a single possibility is added to the
+// pending list for propagate().  Spots with a value already set have no
+// possibilities, so are left alone.
+// Return value:
+//    true - OK so far
+//    false - the spot was left with no possibilities, so the puzzle can't be solved
+//            from here.  The pending list is cleared.
+template <int BOX_ROWS, int BOX_COLS, typename Tracer>
+bool BasicSudokuPuzzle<BOX_ROWS, BOX_COLS, Tracer>::removePossibilities(const int row, const int col, const CandidateMask mask) {
+    CandidateMask remaining = possibilities[row][col];
+    if ((remaining & mask) == 0) {
+        return true;
+    }
+    remaining &= ~mask;
+    narrowPossibilities(row, col, remaining);
+    if (remaining == 0) {
+        numPending = 0;
+        return false;
+    }
+    if ((remaining & (remaining - 1)) == 0) {
+        pending[numPending++] = Spot{ uint8_t(row), uint8_t(col) };
+    }
+    return true;
+}
+
+// removePossibilities() for the deduction rules, counting the values removed for the
+// stats.  Those removed by assignValue() are counted there.
+template <int BOX_ROWS, int BOX_COLS, typename Tracer>
+bool BasicSudokuPuzzle<BOX_ROWS, BOX_COLS, Tracer>::eliminate(const int row, const int col, const CandidateMask mask) {
+    stats.candidatesEliminated += countCandidates(CandidateMask(possibilities[row][col] & mask));
+    return removePossibilities(row, col, mask);
+}
+
+// Undo changes from the trail, most recent first, until only the first mark
+// entries remain.  Anything still on the pending list came from the changes being
+// undone, so it is dropped too.
+template <int BOX_ROWS, int BOX_COLS, typename Tracer>
+void BasicSudokuPuzzle<BOX_ROWS, BOX_COLS, Tracer>::undoTo(const int mark) {
+    numPending = 0;
+    while (trailSize > mark) {
+        const TrailEntry& entry = trail[--trailSize];
+        int value = board[entry.row][entry.col];
+        if (value != 0) {
+            // Undoing the setting of a value.  The board is consistent during the search,
+            // so this was the only use of the value in its row, column and submatrix.
+            CandidateMask bit = candidateBit(value);
+            rowUsed[entry.row] &= ~bit;
+            colUsed[entry.col] &= ~bit;
+            boxUsed[boxIndex(entry.row, entry.col)] &= ~bit;
+            board[entry.row][entry.col] = 0;
+            numBlank++;
+        }
+        possibilities[entry.row][entry.col] = entry.oldPossibilities;
+    }
+}
+
+// Work out everything setValue() keeps up to date from the board: the masks of
+// values used in each row, column and submatrix, the repeats, the values out of
+// range and the blank spots.
+template <int BOX_ROWS, int BOX_COLS, typename Tracer>
+void BasicSudokuPuzzle<BOX_ROWS, BOX_COLS, Tracer>::countValues() {
+    for (int idx=0; idx < SIZE; idx++) {
+        rowUsed[idx] = colUsed[idx] = boxUsed[idx] = 0;
+        for (int value=0; value < SIZE; value++) {
+            rowRepeats[idx][value] = colRepeats[idx][value] = boxRepeats[idx][value] = 0;
+        }
+    }
+    numConflicts = numBadValues = numBlank = 0;
+    for (int row=0; row < SIZE; row++) {
+        for (int col=0; col < SIZE; col++) {
+            int value = board[row][col];
+            if (value == 0) numBlank++;
+            else if (value >= 1 && value <= SIZE) addUse(row, col, value);
+            else numBadValues++;
+        }
+    }
+}
+
+// Check the row of the puzzle to make sure each entry in the row is both
+// unique and a valid value (int 0 - SIZE only, zero being used to represent blank),
+//                        OR
+// Check the column of the puzzle for uniqueness.
+// Only used by isSolutionValid(true), so what is found is printed to stdout.
+//
+// Return value:
+//    true - The row (or col) is OK
+//    false - The row (or col) is NOT OK.  There is either an invalid value  or a
+//            duplicate within the row (or col).
+template <int BOX_ROWS, int BOX_COLS, typename Tracer>
+bool BasicSudokuPuzzle<BOX_ROWS, BOX_COLS, Tracer>::isRowOrColOk(const int row, const RowOrCol which) const {
+    // Check row for valid and non-repeating values.  The non-repeating
+    // aspect will be done by setting the bit for each value in a mask,
+    // checking first whether that bit is already set.
+    CandidateMask values = 0;
+
+    // Check the row to make sure it doesn't have any duplicates
+    for (int col = 0; col < SIZE; col++) {
+        int value;
+
+        // If we're checking a row, grab the value using indices as expected, but
+        // if we're checking a column, switch the indices.  This lets us check
+        // either with one method instead of two nearly identical methods.
+        if (which == RowOrCol::ROW) value = board[row][col];
+        else value = board[col][row];
+
+        if (value < 0 || value > SIZE) {
+            if (which == RowOrCol::ROW) std::cout << "row " << row << " has an invalid value: " << value << std::endl;
+            else std::cout << "col " << row << " has an invalid value: " << value << std::endl;
+            return false;
+        }
+
+        // Check uniqueness
+        if (value != 0) {
+            if (values & candidateBit(value)) { // If the value is already in the mask
+                // Do the appropriate message depending on if we're checking rows or columns
+                if (which == RowOrCol::ROW) std::cout << "row " << row << " has a repeat value: " << value << std::endl;
+                else std::cout << "col " << row << " has a repeat value: " << value << std::endl;
+                // Yes, we really want to use the row variable in the line above, since in the
+                // case of checking columns, the meanings of the row and col variables are reversed.
+                return false;
+            }
+            values |= candidateBit(value);
+        }
+    }
+    // Do the appropriate message depending on if we're checking rows or columns
+    if (which == RowOrCol::ROW) std::cout << "row " << row << " is OK." << std::endl;
+    else std::cout << "col " << row << " is OK." << std::endl;
+    // Yes, we really want to use the row variable in the line above, since in the
+    // case of checking columns, the meanings of the row and col variables are reversed.
+    return true;
+}
+
+// Check the specified submatrix of the puzzle to make sure each entry in the submatrix is unique.
+// Only used by isSolutionValid(true), so what is found is printed to stdout.
+// Return value:
+//    true - The submatrix is OK
+//    false - The submatrix are NOT OK.  There is a duplicate within the submatrix.
+template <int BOX_ROWS, int BOX_COLS, typename Tracer>
+bool BasicSudokuPuzzle<BOX_ROWS, BOX_COLS, Tracer>::isSubmatrixOk(const int startRowIdx, const int startColIdx) const {
+    CandidateMask values = 0;
+    int stopRowIdx = startRowIdx + BOX_ROWS; // Stop indices are exclusive
+    int stopColIdx = startColIdx + BOX_COLS;
+    for (int row = startRowIdx; row < stopRowIdx; row++) {
+        for (int col = startColIdx; col < stopColIdx; col++) {
+            int value = board[row][col];
+            if (value != 0) {
+                if (values & candidateBit(value)) {
+                    std::cout << "Submatrix with starting row " << startRowIdx <<
+                        " and starting column " << startColIdx << " has a repeat value: " << value << std::endl;
+                    return false;
+                }
+                values |= candidateBit(value);
+            }
+        }
+    }
+    std::cout << "Submatrix with starting row " << startRowIdx << " and starting column " <<
+        startColIdx << " is OK." << std::endl;
+    return true;
+}
+
+// Check the submatrices of the puzzle to make sure each entry in each submatrix is unique.
+// Return value:
+//    true - The submatrices are OK
+//    false - The submatrices are NOT OK.  There is a duplicate within one or more submatrix.
+template <int BOX_ROWS, int BOX_COLS, typename Tracer>
+bool BasicSudokuPuzzle<BOX_ROWS, BOX_COLS, Tracer>::areSubmatricesOk() const {
+    // Check sub-matrices (the SIZE boxes of BOX_ROWS x BOX_COLS)
+    for (int startRow = 0; startRow < SIZE; startRow += BOX_ROWS) {
+        for (int startCol = 0; startCol < SIZE; startCol += BOX_COLS) {
+            if (!isSubmatrixOk(startRow, startCol))
+                return false;
+        }
+    }
+    return true;
+}
+
+
+template <int BOX_ROWS, int BOX_COLS, typename Tracer>
+bool BasicSudokuPuzzle<BOX_ROWS, BOX_COLS, Tracer>::isSolutionValid(bool verbose) const {
+    if (!verbose) {
+        // No need to report which row, column or submatrix is at fault.
+        return isConsistent();
+    }
+    // Check rows
+    for (int row = 0; row < SIZE; row++) {
+        if (!isRowOrColOk(row)) // ROW is default
+            return false;
+    }
+    // Check columns
+    for (int col = 0; col < SIZE; col++) {
+        if (!isRowOrColOk(col, RowOrCol::COL))
+            return false;
+    }
+    return areSubmatricesOk();
+}
+
+template <int BOX_ROWS, int BOX_COLS, typename Tracer>
+bool BasicSudokuPuzzle<BOX_ROWS, BOX_COLS, Tracer>::isConsistent() const {
+    return numConflicts == 0 && numBadValues == 0;
+}
+
+template <int BOX_ROWS, int BOX_COLS, typename Tracer>
+bool BasicSudokuPuzzle<BOX_ROWS, BOX_COLS, Tracer>::isComplete() const {
+    return numBlank == 0 && isConsistent();
+}
+
+template <int BOX_ROWS, int BOX_COLS, typename Tracer>
+int BasicSudokuPuzzle<BOX_ROWS, BOX_COLS, Tracer>::getConflictCount() const {
+    return numConflicts;
+}
+
+// Print the contents of the puzzle to stdout.
+template <int BOX_ROWS, int BOX_COLS, typename Tracer>
+void BasicSudokuPuzzle<BOX_ROWS, BOX_COLS, Tracer>::print() const {
+    // Values above 9 are shown as letters, so every spot is one character wide.
+    const std::string divider(4 * SIZE + 1, '-');
+    std::cout << divider << std::endl;
+    for (int row=0; row < SIZE; row++) {
+        std::cout << "|";
+        for (int col=0; col < SIZE; col++) {
+            if (board[row][col] == 0) std::cout << "   |";
+            else std::cout << " " << valueToChar(board[row][col]) << " |";
+        }
+        std::cout << std::endl;
+        std::cout << divider << std::endl;
+    }
+}
+
+// For every blank space on the board, set the possibilities to the values not
+// already used in its row, column or submatrix, and count the blank spaces.  Spaces
+// with only one possibility are added to the pending list for propagate().
+// Return value:
+//    true - OK so far
+//    false - some blank space has no possibilities; the puzzle can't be solved.
+template <int BOX_ROWS, int BOX_COLS, typename Tracer>
+bool BasicSudokuPuzzle<BOX_ROWS, BOX_COLS, Tracer>::setAllPossibilities() {
+    numBlank = 0;
+    numPending = 0;
+    for (int row=0; row < SIZE; row++) {
+        for (int col=0; col < SIZE; col++) {
+            if (board[row][col] == 0) {
+                CandidateMask used = rowUsed[row] | colUsed[col] | boxUsed[boxIndex(row, col)];
+                possibilities[row][col] = ALL_CANDIDATES & ~used;
+                numBlank++;
+                if (possibilities[row][col] == 0) {
+                    numPending = 0;
+                    return false;
+                }
+                if (countCandidates(possibilities[row][col]) == 1) {
+                    pending[numPending++] = Spot{ uint8_t(row), uint8_t(col) };
+                }
+            }
+            else {
+                possibilities[row][col] = 0;
+            }
+        }
+    }
+    return true;
+}
+
+// Set the value of every spot on the pending list, which in turn may add more spots
+// to the list, until nothing more is forced.  Only the peers of each spot that gets
+// its value set are looked at.
+// Return value:
+//    The number of spots that are still blank (should be between 0 and NUM_SPOTS), or -1 if
+//    some spot has no possibilities left, meaning the puzzle can't be solved.
+template <int BOX_ROWS, int BOX_COLS, typename Tracer>
+int BasicSudokuPuzzle<BOX_ROWS, BOX_COLS, Tracer>::propagate() {
+    stats.propagationPasses++;
+    while (numPending > 0) {
+        Spot spot = pending[--numPending];
+        if (board[spot.row][spot.col] != 0) continue;
+        int value = lowestCandidate(possibilities[spot.row][spot.col]);
+        Tracer::forcedValue(spot.row, spot.col, value);
+        if (!assignValue(spot.row, spot.col, value)) {
+            Tracer::contradiction();
+            return -1;
+        }
+    }
+    Tracer::propagated(numBlank);
+    return numBlank;
+}
+
+template <int BOX_ROWS, int BOX_COLS, typename Tracer>
+const typename BasicSudokuPuzzle<BOX_ROWS, BOX_COLS, Tracer>::RuleEntry BasicSudokuPuzzle<BOX_ROWS, BOX_COLS, Tracer>::RULE_TABLE[6] = {
+    { HIDDEN_SINGLES, "Hidden singles", &BasicSudokuPuzzle::findHiddenSingles },
+    { BOX_LINE_REDUCTION, "Box/line reduction", &BasicSudokuPuzzle::findBoxLineReductions },
+    { NAKED_PAIRS, "Naked pairs", &BasicSudokuPuzzle::findNakedPairs },
+    { HIDDEN_PAIRS, "Hidden pairs", &BasicSudokuPuzzle::findHiddenPairs },
+    { NAKED_TRIPLES, "Naked triples", &BasicSudokuPuzzle::findNakedTriples },
+    { HIDDEN_TRIPLES, "Hidden triples", &BasicSudokuPuzzle::findHiddenTriples },
+};
+
+template <int BOX_ROWS, int BOX_COLS, typename Tracer>
+void BasicSudokuPuzzle<BOX_ROWS, BOX_COLS, Tracer>::setRules(const unsigned rules) {
+    this->rules = rules & ALL_RULES;
+}
+
+template <int BOX_ROWS, int BOX_COLS, typename Tracer>
+unsigned BasicSudokuPuzzle<BOX_ROWS, BOX_COLS, Tracer>::getRules() const {
+    return rules;
+}
+
+template <int BOX_ROWS, int BOX_COLS, typename Tracer>
+void BasicSudokuPuzzle<BOX_ROWS, BOX_COLS, Tracer>::setBackend(const SolverBackend backend) {
+    this->backend = backend;
+}
+
+template <int BOX_ROWS, int BOX_COLS, typename Tracer>
+SolverBackend BasicSudokuPuzzle<BOX_ROWS, BOX_COLS, Tracer>::getBackend() const {
+    return backend;
+}
+
+template <int BOX_ROWS, int BOX_COLS, typename Tracer>
+void BasicSudokuPuzzle<BOX_ROWS, BOX_COLS, Tracer>::setSearchPolicy(const SearchPolicy& policy) {
+    this->policy = policy;
+}
+
+template <int BOX_ROWS, int BOX_COLS, typename Tracer>
+const SearchPolicy& BasicSudokuPuzzle<BOX_ROWS, BOX_COLS, Tracer>::getSearchPolicy() const {
+    return policy;
+}
+
+template <int BOX_ROWS, int BOX_COLS, typename Tracer>
+const SolverStats& BasicSudokuPuzzle<BOX_ROWS, BOX_COLS, Tracer>::getStats() const {
+    return stats;
+}
+
+// Try each enabled deduction rule in turn, cheapest first, stopping at the first
+// that gets somewhere so that the spots it forced can be set before trying the
+// more expensive ones.
+// Return value:
+//    1 - a rule removed some possibilities
+//    0 - none of the rules found anything
+//    -1 - a rule found that the puzzle can't be solved from here
+template <int BOX_ROWS, int BOX_COLS, typename Tracer>
+int BasicSudokuPuzzle<BOX_ROWS, BOX_COLS, Tracer>::applyRules() {
+    for (const RuleEntry& entry : RULE_TABLE) {
+        if ((rules & entry.rule) == 0) continue;
+        int rc = (this->*entry.apply)();
+        if (rc != 0) {
+            Tracer::ruleApplied(entry.name, rc);
+            if (rc == 1) stats.ruleSuccesses++;
+            return rc;
+        }
+    }
+    return 0;
+}
+
+// For each value, find which spots of a unit could still have it.  Bit i of
+// places[value - 1] is set when the i-th spot of the unit (as listed in UNITS)
+// is blank and has that value as a possibility.
+template <int BOX_ROWS, int BOX_COLS, typename Tracer>
+void BasicSudokuPuzzle<BOX_ROWS, BOX_COLS, Tracer>::findPlaces(const int unit, CandidateMask (&places)[SIZE]) const {
+    for (int idx=0; idx < SIZE; idx++) {
+        places[idx] = 0;
+    }
+    for (int pos=0; pos < SIZE; pos++) {
+        const Spot& spot = UNITS.spots[unit][pos];
+        for (CandidateMask remaining = possibilities[spot.row][spot.col]; remaining != 0; remaining &= remaining - 1) {
+            places[lowestCandidate(remaining) - 1] |= maskBit(pos);
+        }
+    }
+}
+
+// Remove the given values from every spot of a unit except those whose bit is set
+// in keepPositions (bit i for the i-th spot, as listed in UNITS).
+// Return value:
+//    1 - some possibilities were removed
+//    0 - nothing changed
+//    -1 - a spot was left with no possibilities
+template <int BOX_ROWS, int BOX_COLS, typename Tracer>
+int BasicSudokuPuzzle<BOX_ROWS, BOX_COLS, Tracer>::removeFromUnit(const int unit, const CandidateMask keepPositions, const CandidateMask values) {
+    int rc = 0;
+    for (int pos=0; pos < SIZE; pos++) {
+        if (keepPositions & maskBit(pos)) continue;
+        const Spot& spot = UNITS.spots[unit][pos];
+        if (possibilities[spot.row][spot.col] & values) {
+            if (!eliminate(spot.row, spot.col, values)) {
+                return -1;
+            }
+            rc = 1;
+        }
+    }
+    return rc;
+}
+
+// Hidden singles: if a value can only go in one spot of a row, column or
+// submatrix, it must go there.
+// Return value: as for applyRules()
+template <int BOX_ROWS, int BOX_COLS, typename Tracer>
+int BasicSudokuPuzzle<BOX_ROWS, BOX_COLS, Tracer>::findHiddenSingles() {
+    int rc = 0;
+    for (int unit=0; unit < NUM_UNITS; unit++) {
+        // Find the values possible in exactly one blank spot, and those already set.
+        CandidateMask once = 0, twice = 0, placed = 0;
+        for (const Spot& spot : UNITS.spots[unit]) {
+            int value = board[spot.row][spot.col];
+            if (value != 0) {
+                placed |= candidateBit(value);
+            }
+            else {
+                twice |= once & possibilities[spot.row][spot.col];
+                once |= possibilities[spot.row][spot.col];
+            }
+        }
+        if ((once | placed) != ALL_CANDIDATES) {
+            // Some value can't go anywhere in this unit.
+            return -1;
+        }
+        CandidateMask single = once & ~twice;
+        if (single == 0) continue;
+        for (const Spot& spot : UNITS.spots[unit]) {
+            CandidateMask mine = possibilities[spot.row][spot.col] & single;
+            if (mine == 0) continue;
+            if (mine & (mine - 1)) {
+                // Two different values both have to go in this one spot.
+                return -1;
+            }
+            if (mine == possibilities[spot.row][spot.col]) continue;
+            if (!eliminate(spot.row, spot.col, possibilities[spot.row][spot.col] & ~mine)) {
+                return -1;
+            }
+            rc = 1;
+        }
+    }
+    return rc;
+}
+
+template <int BOX_ROWS, int BOX_COLS, typename Tracer>
+int BasicSudokuPuzzle<BOX_ROWS, BOX_COLS, Tracer>::findNakedPairs() {
+    return findNakedSubsets(2);
+}
+
+template <int BOX_ROWS, int BOX_COLS, typename Tracer>
+int BasicSudokuPuzzle<BOX_ROWS, BOX_COLS, Tracer>::findNakedTriples() {
+    return findNakedSubsets(3);
+}
+
+// Naked pairs and triples: if some number (size) of blank spots in a unit have only
+// that many values between them, those values must go in those spots, so can be
+// removed from every other spot in the unit.
+// Return value: as for applyRules()
+template <int BOX_ROWS, int BOX_COLS, typename Tracer>
+int BasicSudokuPuzzle<BOX_ROWS, BOX_COLS, Tracer>::findNakedSubsets(const int size) {
+    int rc = 0;
+    for (int unit=0; unit < NUM_UNITS; unit++) {
+        // The positions within the unit of blank spots with few enough possibilities
+        // to be part of a subset.
+        int positions[SIZE];
+        int numPositions = 0;
+        int numBlankInUnit = 0;
+        for (int pos=0; pos < SIZE; pos++) {
+            const Spot& spot = UNITS.spots[unit][pos];
+            if (board[spot.row][spot.col] != 0) continue;
+            numBlankInUnit++;
+            if (countCandidates(possibilities[spot.row][spot.col]) <= size) {
+                positions[numPositions++] = pos;
+            }
+        }
+        // A subset covering every blank spot of the unit has nothing to remove.
+        if (numBlankInUnit <= size) continue;
+
+        // Try every combination of size spots (size is 2 or 3, so at most 84 of them).
+        for (int first=0; first < numPositions; first++) {
+            for (int second=first + 1; second < numPositions; second++) {
+                for (int third=(size == 3 ? second + 1 : numPositions); third <= numPositions; third++) {
+                    if (size == 3 && third == numPositions) break;
+                    CandidateMask keep = maskBit(positions[first]) | maskBit(positions[second]);
+                    if (size == 3) keep |= maskBit(positions[third]);
+                    CandidateMask values = 0;
+                    for (int pos=0; pos < SIZE; pos++) {
+                        if (keep & maskBit(pos)) {
+                            const Spot& spot = UNITS.spots[unit][pos];
+                            values |= possibilities[spot.row][spot.col];
+                        }
+                    }
+                    int numValues = countCandidates(values);
+                    if (numValues < size) {
+                        // More spots than values to put in them.
+                        return -1;
+                    }
+                    if (numValues == size) {
+                        int removed = removeFromUnit(unit, keep, values);
+                        if (removed == -1) return -1;
+                        if (removed == 1) rc = 1;
+                    }
+                }
+            }
+        }
+    }
+    return rc;
+}
+
+template <int BOX_ROWS, int BOX_COLS, typename Tracer>
+int BasicSudokuPuzzle<BOX_ROWS, BOX_COLS, Tracer>::findHiddenPairs() {
+    return findHiddenSubsets(2);
+}
+
+template <int BOX_ROWS, int BOX_COLS, typename Tracer>
+int BasicSudokuPuzzle<BOX_ROWS, BOX_COLS, Tracer>::findHiddenTriples() {
+    return findHiddenSubsets(3);
+}
+
+// Hidden pairs and triples: if some number (size) of values can only go in that many
+// spots of a unit between them, those spots must hold those values, so every other
+// possibility can be removed from them.
+// Return value: as for applyRules()
+template <int BOX_ROWS, int BOX_COLS, typename Tracer>
+int BasicSudokuPuzzle<BOX_ROWS, BOX_COLS, Tracer>::findHiddenSubsets(const int size) {
+    int rc = 0;
+    for (int unit=0; unit < NUM_UNITS; unit++) {
+        CandidateMask places[SIZE];
+        findPlaces(unit, places);
+
+        // The values (minus one) that are still to be placed and have few enough
+        // places to be part of a subset.  Values with only one place are hidden singles.
+        int values[SIZE];
+        int numValues = 0;
+        for (int idx=0; idx < SIZE; idx++) {
+            int numPlaces = countCandidates(places[idx]);
+            if (numPlaces >= 2 && numPlaces <= size) {
+                values[numValues++] = idx;
+            }
+        }
+
+        for (int first=0; first < numValues; first++) {
+            for (int second=first + 1; second < numValues; second++) {
+                for (int third=(size == 3 ? second + 1 : numValues); third <= numValues; third++) {
+                    if (size == 3 && third == numValues) break;
+                    CandidateMask subset = maskBit(values[first]) | maskBit(values[second]);
+                    CandidateMask spots = places[values[first]] | places[values[second]];
+                    if (size == 3) {
+                        subset |= maskBit(values[third]);
+                        spots |= places[values[third]];
+                    }
+                    int numSpots = countCandidates(spots);
+                    if (numSpots < size) {
+                        // More values than spots to put them in.
+                        return -1;
+                    }
+                    if (numSpots > size) continue;
+                    for (int pos=0; pos < SIZE; pos++) {
+                        if ((spots & maskBit(pos)) == 0) continue;
+                        const Spot& spot = UNITS.spots[unit][pos];
+                        CandidateMask others = possibilities[spot.row][spot.col] & ~subset;
+                        if (others != 0) {
+                            if (!eliminate(spot.row, spot.col, others)) {
+                                return -1;
+                            }
+                            rc = 1;
+                        }
+                    }
+                }
+            }
+        }
+    }
+    return rc;
+}
+
+// Box/line reduction.  If every place for a value in a submatrix is in the same row
+// (or column), the value must go in that part of the row, so it can be removed from
+// the rest of the row.  Likewise if every place for a value in a row (or column) is
+// in the same submatrix, it can be removed from the rest of the submatrix.
+// Return value: as for applyRules()
+template <int BOX_ROWS, int BOX_COLS, typename Tracer>
+int BasicSudokuPuzzle<BOX_ROWS, BOX_COLS, Tracer>::findBoxLineReductions() {
+    int rc = 0;
+    for (int unit=0; unit < NUM_UNITS; unit++) {
+        CandidateMask places[SIZE];
+        findPlaces(unit, places);
+        for (int idx=0; idx < SIZE; idx++) {
+            CandidateMask where = places[idx];
+            if (countCandidates(where) < 2) continue;
+            const CandidateMask valueBit = candidateBit(idx + 1);
+            int removed = 0;
+            if (unit >= 2 * SIZE) {
+                // A submatrix: positions run left to right, then top to bottom.
+                const int box = unit - 2 * SIZE;
+                const int top = BOX_ROWS * (box / BOX_ROWS);
+                const int left = BOX_COLS * (box % BOX_ROWS);
+                for (int boxRow=0; boxRow < BOX_ROWS && removed == 0; boxRow++) {
+                    if ((where & ~boxRowPositions(boxRow)) == 0) {
+                        // Pointing along a row: keep the positions in this submatrix.
+                        removed = removeFromUnit(top + boxRow, runPositions(left, BOX_COLS), valueBit);
+                    }
+                }
+                for (int boxCol=0; boxCol < BOX_COLS && removed == 0; boxCol++) {
+                    if ((where & ~boxColPositions(boxCol)) == 0) {
+                        removed = removeFromUnit(SIZE + left + boxCol, runPositions(top, BOX_ROWS), valueBit);
+                    }
+                }
+            }
+            else {
+                // A row or column: positions run along it, and it crosses a submatrix
+                // every BOX_COLS (or BOX_ROWS) positions.
+                const bool isRow = unit < SIZE;
+                const int line = unit % SIZE;
+                const int width = isRow ? BOX_COLS : BOX_ROWS;
+                for (int segment=0; segment < SIZE / width && removed == 0; segment++) {
+                    if ((where & ~runPositions(width * segment, width)) == 0) {
+                        // Claiming: keep the spots of the submatrix that are in this line.
+                        int box = isRow ? BOX_ROWS * (line / BOX_ROWS) + segment : BOX_ROWS * segment + line / BOX_COLS;
+                        CandidateMask keep = isRow ? boxRowPositions(line % BOX_ROWS) : boxColPositions(line % BOX_COLS);
+                        removed = removeFromUnit(2 * SIZE + box, keep, valueBit);
+                    }
+                }
+            }
+            if (removed == -1) return -1;
+            if (removed == 1) rc = 1;
+        }
+    }
+    return rc;
+}
+
+// Decide where to guess, as the search policy says, and fill in guesses with the
+// choices in the order to try them.  Every choice but one is wrong, so trying each
+// in turn covers every solution.  Only called when nothing more is forced, so every
+// blank spot has at least two possibilities.
+// Return value:
+//    The number of choices; zero if some value has no place left in a unit
+template <int BOX_ROWS, int BOX_COLS, typename Tracer>
+int BasicSudokuPuzzle<BOX_ROWS, BOX_COLS, Tracer>::chooseBranch(Guess (&guesses)[SIZE]) const {
+    const BranchRule branch = policy.branch;
+    uint8_t places[NUM_UNITS][SIZE];
+    if (branch == BranchRule::FEWEST_PLACES_TIEBREAK || branch == BranchRule::FEWEST_PLACES) {
+        countPlaces(places);
+    }
+
+    // The spot with the fewest possibilities, ties broken as the policy says.  Nothing
+    // can have fewer than two, so with no tie break the first with two will do.
+    int bestRow = -1, bestCol = -1;
+    int fewest = SIZE + 1;
+    int bestTieScore = 0;
+    for (int row=0; row < SIZE; row++) {
+        for (int col=0; col < SIZE; col++) {
+            if (board[row][col] != 0) continue;
+            const int count = countCandidates(possibilities[row][col]);
+            if (count > fewest) continue;
+            int tieScore = 0;
+            if (branch == BranchRule::MOST_BLANK_PEERS) {
+                tieScore = countBlankPeers(row, col);
+            }
+            else if (branch == BranchRule::FEWEST_PLACES_TIEBREAK) {
+                // Lower is better, so count down from the most places there could be.
+                const int units[3] = { row, SIZE + col, 2 * SIZE + boxIndex(row, col) };
+                int nearest = SIZE;
+                for (CandidateMask remaining = possibilities[row][col]; remaining != 0; remaining &= remaining - 1) {
+                    const int value = lowestCandidate(remaining);
+                    for (int unit : units) nearest = std::min(nearest, int(places[unit][value - 1]));
+                }
+                tieScore = SIZE - nearest;
+            }
+            if (count < fewest || tieScore > bestTieScore) {
+                fewest = count;
+                bestRow = row;
+                bestCol = col;
+                bestTieScore = tieScore;
+            }
+        }
+        if (fewest <= 2 && branch == BranchRule::FEWEST_POSSIBILITIES) break;
+    }
+
+    int numGuesses = 0;
+    int bestUnit = -1, bestValue = 0, fewestPlaces = SIZE + 1;
+    if (branch == BranchRule::FEWEST_PLACES) {
+        for (int unit=0; unit < NUM_UNITS && fewestPlaces > 0; unit++) {
+            const Spot first = UNITS.spots[unit][0];
+            const CandidateMask used = unit < SIZE ? rowUsed[first.row] :
+                                       unit < 2 * SIZE ? colUsed[first.col] : boxUsed[boxIndex(first.row, first.col)];
+            for (int value=1; value <= SIZE; value++) {
+                if ((used & candidateBit(value)) == 0 && places[unit][value - 1] < fewestPlaces) {
+                    fewestPlaces = places[unit][value - 1];
+                    bestUnit = unit;
+                    bestValue = value;
+                }
+            }
+        }
+    }
+    if (bestUnit >= 0 && fewestPlaces < fewest) {
+        for (const Spot& spot : UNITS.spots[bestUnit]) {
+            if (board[spot.row][spot.col] == 0 && (possibilities[spot.row][spot.col] & candidateBit(bestValue)) != 0) {
+                guesses[numGuesses++] = Guess{ spot.row, spot.col, uint8_t(bestValue) };
+            }
+        }
+    }
+    else if (bestRow >= 0) {
+        for (CandidateMask remaining = possibilities[bestRow][bestCol]; remaining != 0; remaining &= remaining - 1) {
+            guesses[numGuesses++] = Guess{ uint8_t(bestRow), uint8_t(bestCol), uint8_t(lowestCandidate(remaining)) };
+        }
+    }
+
+    if (policy.order != ValueOrder::ASCENDING && numGuesses > 1) {
+        // Insertion sort on how many blank peers each choice constrains; stable, so ties
+        // stay in ascending order.
+        int scores[SIZE];
+        for (int idx=0; idx < numGuesses; idx++) {
+            const int constrained = peersWithValue(guesses[idx].row, guesses[idx].col, guesses[idx].value);
+            scores[idx] = policy.order == ValueOrder::LEAST_CONSTRAINING ? constrained : -constrained;
+        }
+        for (int idx=1; idx < numGuesses; idx++) {
+            const Guess guess = guesses[idx];
+            const int score = scores[idx];
+            int pos = idx;
+            for (; pos > 0 && scores[pos - 1] > score; pos--) {
+                guesses[pos] = guesses[pos - 1];
+                scores[pos] = scores[pos - 1];
+            }
+            guesses[pos] = guess;
+            scores[pos] = score;
+        }
+    }
+    return numGuesses;
+}
+
+// For each unit and value (indexed from zero), how many blank spots of the unit still
+// have the value as a possibility.
+template <int BOX_ROWS, int BOX_COLS, typename Tracer>
+void BasicSudokuPuzzle<BOX_ROWS, BOX_COLS, Tracer>::countPlaces(uint8_t (&places)[NUM_UNITS][SIZE]) const {
+    for (int unit=0; unit < NUM_UNITS; unit++) {
+        for (int value=0; value < SIZE; value++) places[unit][value] = 0;
+        for (const Spot& spot : UNITS.spots[unit]) {
+            for (CandidateMask remaining = possibilities[spot.row][spot.col]; remaining != 0; remaining &= remaining - 1) {
+                places[unit][lowestCandidate(remaining) - 1]++;
+            }
+        }
+    }
+}
+
+// The number of blank spots sharing a row, column or submatrix with the given one.
+template <int BOX_ROWS, int BOX_COLS, typename Tracer>
+int BasicSudokuPuzzle<BOX_ROWS, BOX_COLS, Tracer>::countBlankPeers(const int row, const int col) const {
+    int count = 0;
+    for (const Spot& peer : PEERS.peers[row][col]) {
+        if (board[peer.row][peer.col] == 0) count++;
+    }
+    return count;
+}
+
+// The number of blank peers of the given spot that still have value as a possibility,
+// i.e. how many would lose a possibility if the spot were set to it.
+template <int BOX_ROWS, int BOX_COLS, typename Tracer>
+int BasicSudokuPuzzle<BOX_ROWS, BOX_COLS, Tracer>::peersWithValue(const int row, const int col, const int value) const {
+    const CandidateMask bit = candidateBit(value);
+    int count = 0;
+    for (const Spot& peer : PEERS.peers[row][col]) {
+        if (possibilities[peer.row][peer.col] & bit) count++;
+    }
+    return count;
+}
+
+// Print out the list of possibilities for each spot
+template <int BOX_ROWS, int BOX_COLS, typename Tracer>
+void BasicSudokuPuzzle<BOX_ROWS, BOX_COLS, Tracer>::listPossibilities() const {
+    for (int row=0; row < SIZE; row++) {
+        for (int col=0; col < SIZE; col++) {
+            if (board[row][col] == 0) {
+                std::cout << "For row " << row << ", col " << col << ", possibilities are: ";
+                for (CandidateMask remaining = possibilities[row][col]; remaining != 0; remaining &= remaining - 1) {
+                    std::cout << lowestCandidate(remaining) << " ";
+                }
+                std::cout << std::endl;
+            }
+        }
+    }
+}
+
+#endif // SUDOKUPUZZLE_H
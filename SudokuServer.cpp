@@ -0,0 +1,399 @@
+//============================================================================
+// Name        : SudokuServer.cpp
+// Author      : Jeff Hancock
+//               https://www.linkedin.com/in/jeffreythancock/
+// Copyright   : Carte blanche.  Plagiarize at will.
+// Description : A long running solver.  Takes 9x9 puzzles, one per line, from
+//               clients of a Unix domain socket (or from stdin), gathers
+//               whatever arrives close together into batches for a pool of
+//               threads that is started once, and writes each solution back
+//               with the id it came with.
+//============================================================================
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
+#include <csignal>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include "SudokuPuzzle.h"
+#include "SolutionCache.h"
+#include "ThreadPool.h"
+using namespace std;
+
+struct ServerOptions {
+    // The socket to listen on.  Empty to serve stdin and stdout instead.
+    string socketPath;
+    // Zero for one thread per hardware thread.
+    unsigned numThreads = 0;
+    // The most requests waiting to be solved.  Once there are this many, no more are
+    // read from any client until some are done.
+    size_t maxQueued = 4096;
+    // The most requests solved together, and how long to wait for more to arrive
+    // before solving a batch that isn't full.
+    size_t maxBatch = 256;
+    chrono::microseconds batchWindow{100};
+    SolverBackend backend = SolverBackend::PROPAGATION;
+    // How many solutions to cache by canonical form.  Zero for no cache.
+    size_t cacheSize = 0;
+};
+
+// One client.  Responses from the solving threads and the reader are written whole
+// under writeLock, so lines never interleave.  The descriptor is closed once the
+// reader is done with it and every request from it has been answered.
+struct Connection {
+    int inFd;
+    int outFd;
+    mutex writeLock;
+
+    Connection(const int inFd, const int outFd) : inFd(inFd), outFd(outFd) {}
+
+    Connection(const Connection& from) = delete;
+    Connection& operator=(const Connection& from) = delete;
+
+    ~Connection() {
+        if (inFd > STDERR_FILENO) ::close(inFd);
+        if (outFd > STDERR_FILENO && outFd != inFd) ::close(outFd);
+    }
+
+    // Write all of text, giving up quietly if the client has gone.
+    void send(const string& text) {
+        lock_guard<mutex> guard(writeLock);
+        size_t done = 0;
+        while (done < text.size()) {
+            ssize_t wrote = ::write(outFd, text.data() + done, text.size() - done);
+            if (wrote < 0 && errno == EINTR) continue;
+            if (wrote <= 0) return;
+            done += size_t(wrote);
+        }
+    }
+};
+
+// A puzzle to solve, and then its result.
+struct Request {
+    shared_ptr<Connection> connection;
+    string id;
+    uint8_t cells[SudokuPuzzle::NUM_SPOTS];
+    SolveStatus status;
+};
+
+// Counts kept for the STATS command.
+struct ServerStats {
+    atomic<long> received{0};
+    atomic<long> served{0};
+    atomic<long> invalid{0};
+    atomic<long> batches{0};
+    // How many times a reader had to wait for room in the queue.
+    atomic<long> backpressureWaits{0};
+    atomic<size_t> maxQueued{0};
+    // Total time from a request being queued to its answer being written.
+    atomic<long> totalLatencyUs{0};
+};
+
+// The requests waiting to be solved, in arrival order, with room for a fixed number.
+class RequestQueue {
+
+public:
+
+    explicit RequestQueue(const size_t capacity, ServerStats& stats) : capacity(capacity), stats(stats) {}
+
+    // Add a request, first waiting for room if the queue is full.
+    void push(Request&& request) {
+        unique_lock<mutex> guard(lock);
+        if (items.size() >= capacity) {
+            stats.backpressureWaits.fetch_add(1, memory_order_relaxed);
+            roomAvailable.wait(guard, [this] { return items.size() < capacity; });
+        }
+        items.push_back({ move(request), chrono::steady_clock::now() });
+        size_t depth = items.size();
+        if (depth > stats.maxQueued.load(memory_order_relaxed)) stats.maxQueued.store(depth, memory_order_relaxed);
+        guard.unlock();
+        workAvailable.notify_one();
+    }
+
+    // No more requests will be pushed.
+    void close() {
+        {
+            lock_guard<mutex> guard(lock);
+            closed = true;
+        }
+        workAvailable.notify_all();
+    }
+
+    // Wait for at least one request, then take up to maxBatch of them, waiting up to
+    // window after the first for the batch to fill.  Each request's queue time goes
+    // in queued.
+    // Return value:
+    //    true - batch has requests
+    //    false - the queue is closed and empty
+    bool popBatch(const size_t maxBatch, const chrono::microseconds window, vector<Request>& batch,
+                  vector<chrono::steady_clock::time_point>& queued) {
+        batch.clear();
+        queued.clear();
+        unique_lock<mutex> guard(lock);
+        workAvailable.wait(guard, [this] { return !items.empty() || closed; });
+        if (items.empty()) return false;
+        auto deadline = chrono::steady_clock::now() + window;
+        workAvailable.wait_until(guard, deadline, [this, maxBatch] { return items.size() >= maxBatch || closed; });
+        while (!items.empty() && batch.size() < maxBatch) {
+            batch.push_back(move(items.front().request));
+            queued.push_back(items.front().queued);
+            items.pop_front();
+        }
+        guard.unlock();
+        roomAvailable.notify_all();
+        return true;
+    }
+
+    size_t depth() {
+        lock_guard<mutex> guard(lock);
+        return items.size();
+    }
+
+private:
+    struct Item {
+        Request request;
+        chrono::steady_clock::time_point queued;
+    };
+
+    const size_t capacity;
+    ServerStats& stats;
+    mutex lock;
+    condition_variable workAvailable;
+    condition_variable roomAvailable;
+    deque<Item> items;
+    bool closed = false;
+};
+
+// Decode a one line 9x9 puzzle (as in .sdm files, '0' or '.' for a blank).
+// Return value:
+//    true - OK
+//    false - the text isn't exactly that
+bool parsePuzzle(const string_view text, uint8_t (&cells)[SudokuPuzzle::NUM_SPOTS]) {
+    if (text.size() != size_t(SudokuPuzzle::NUM_SPOTS)) return false;
+    for (int idx=0; idx < SudokuPuzzle::NUM_SPOTS; idx++) {
+        int value = (text[idx] == '.') ? 0 : charToValue(text[idx]);
+        if (value < 0 || value > SudokuPuzzle::SIZE) return false;
+        cells[idx] = uint8_t(value);
+    }
+    return true;
+}
+
+// The reply to the STATS command: one line of name=value pairs.
+string describeStats(const ServerStats& stats, RequestQueue& queue, const ThreadPool& pool) {
+    long served = stats.served.load();
+    long batches = stats.batches.load();
+    char line[512];
+    snprintf(line, sizeof(line),
+             "STATS threads=%u queued=%zu max_queued=%zu received=%ld served=%ld invalid=%ld batches=%ld "
+             "avg_batch=%.1f backpressure_waits=%ld avg_latency_us=%.1f\n",
+             pool.size(), queue.depth(), stats.maxQueued.load(), stats.received.load(), served,
+             stats.invalid.load(), batches, batches > 0 ? double(served) / double(batches) : 0.0,
+             stats.backpressureWaits.load(),
+             served > 0 ? double(stats.totalLatencyUs.load()) / double(served) : 0.0);
+    return line;
+}
+
+// Read one client's requests until it closes its end.  Each line is "id puzzle", or
+// just "puzzle" to use the line number as the id, or "STATS".  Malformed lines are
+// answered "id invalid" straight away.
+void readRequests(const shared_ptr<Connection> connection, RequestQueue& queue, ServerStats& stats,
+                  const ThreadPool& pool) {
+    LineSource source;
+    source.attach(connection->inFd, 65536);
+    string_view line;
+    while (source.nextLine(line)) {
+        if (line.empty() || line[0] == '#') continue;
+        if (line == "STATS") {
+            connection->send(describeStats(stats, queue, pool));
+            continue;
+        }
+        stats.received.fetch_add(1, memory_order_relaxed);
+        Request request;
+        request.connection = connection;
+        size_t space = line.find(' ');
+        string_view puzzle = line;
+        if (space == string_view::npos) {
+            request.id = to_string(source.lineNumber());
+        }
+        else {
+            request.id = string(line.substr(0, space));
+            puzzle = line.substr(space + 1);
+        }
+        if (!parsePuzzle(puzzle, request.cells)) {
+            stats.invalid.fetch_add(1, memory_order_relaxed);
+            connection->send(request.id + " invalid\n");
+            continue;
+        }
+        queue.push(move(request));
+    }
+}
+
+// Take batches off the queue until it is closed, solve each across the pool, and send
+// every client its answers from the batch in one write.
+void dispatch(const ServerOptions& options, RequestQueue& queue, ServerStats& stats, ThreadPool& pool,
+              SolutionCache* cache) {
+    vector<Request> batch;
+    vector<chrono::steady_clock::time_point> queued;
+    while (queue.popBatch(options.maxBatch, options.batchWindow, batch, queued)) {
+        pool.forEach(batch.size(), [&](size_t idx, unsigned) {
+            Request& request = batch[idx];
+            if (cache != nullptr) {
+                request.status = cache->solve(request.cells, request.cells, options.backend);
+            }
+            else {
+                SudokuPuzzle sp(request.cells);
+                sp.setBackend(options.backend);
+                request.status = sp.solveInto(request.cells);
+            }
+        });
+
+        // Requests from one client are usually next to each other, so gather runs.
+        auto now = chrono::steady_clock::now();
+        string out;
+        for (size_t idx=0; idx < batch.size(); idx++) {
+            const Request& request = batch[idx];
+            out += request.id;
+            out += ' ';
+            switch (request.status) {
+            case SolveStatus::SOLVED:
+                for (uint8_t value : request.cells) out += valueToChar(value);
+                break;
+            case SolveStatus::UNSOLVABLE:
+                out += "unsolvable";
+                break;
+            case SolveStatus::INVALID:
+                out += "invalid";
+                break;
+            }
+            out += '\n';
+            stats.totalLatencyUs.fetch_add(long(chrono::duration_cast<chrono::microseconds>(now - queued[idx]).count()),
+                                           memory_order_relaxed);
+            if (idx + 1 == batch.size() || batch[idx + 1].connection != request.connection) {
+                request.connection->send(out);
+                out.clear();
+            }
+        }
+        stats.served.fetch_add(long(batch.size()), memory_order_relaxed);
+        stats.batches.fetch_add(1, memory_order_relaxed);
+        // Let go of the connections so finished clients get closed.
+        batch.clear();
+    }
+}
+
+// Listen on the socket and start a reader for each client.
+// Return value:
+//    false - the socket couldn't be set up (otherwise this doesn't return)
+bool serveSocket(const string& path, RequestQueue& queue, ServerStats& stats, const ThreadPool& pool) {
+    int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+    sockaddr_un address{};
+    address.sun_family = AF_UNIX;
+    if (listener < 0 || path.size() >= sizeof(address.sun_path)) {
+        cerr << path << ": can't create socket" << endl;
+        return false;
+    }
+    strcpy(address.sun_path, path.c_str());
+    unlink(path.c_str());
+    if (bind(listener, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0 || listen(listener, 128) != 0) {
+        cerr << path << ": " << strerror(errno) << endl;
+        return false;
+    }
+    cerr << "Listening on " << path << " with " << pool.size() << " threads." << endl;
+    while (true) {
+        int client = accept(listener, nullptr, nullptr);
+        if (client < 0) {
+            if (errno == EINTR || errno == ECONNABORTED) continue;
+            cerr << path << ": " << strerror(errno) << endl;
+            return false;
+        }
+        auto connection = make_shared<Connection>(client, client);
+        thread(readRequests, connection, ref(queue), ref(stats), cref(pool)).detach();
+    }
+}
+
+void printUsage() {
+    cerr << "Usage: SudokuServer [options]" << endl;
+    cerr << "Solve 9x9 puzzles sent one per line as \"id puzzle\", answering \"id solution\"," << endl;
+    cerr << "\"id unsolvable\" or \"id invalid\".  A line \"STATS\" gets the server's counters." << endl;
+    cerr << "  --socket PATH      Listen on a Unix domain socket (default: serve stdin and stdout)" << endl;
+    cerr << "  --threads N        Solving threads (default: one per hardware thread)" << endl;
+    cerr << "  --max-queued N     Stop reading requests while N are waiting (default: 4096)" << endl;
+    cerr << "  --max-batch N      Solve at most N requests together (default: 256)" << endl;
+    cerr << "  --batch-window US  Wait up to US microseconds to fill a batch (default: 100)" << endl;
+    cerr << "  --dlx              Solve with Dancing Links instead of propagation and guessing" << endl;
+    cerr << "  --cache N          Remember up to N solutions by canonical form" << endl;
+}
+
+int main(int argc, char* argv[]) {
+    ServerOptions options;
+    for (int arg=1; arg < argc; arg++) {
+        string opt = argv[arg];
+        bool hasValue = arg + 1 < argc;
+        if (opt == "--socket" && hasValue) options.socketPath = argv[++arg];
+        else if (opt == "--threads" && hasValue) options.numThreads = unsigned(atoi(argv[++arg]));
+        else if (opt == "--max-queued" && hasValue) options.maxQueued = max<size_t>(1, size_t(atol(argv[++arg])));
+        else if (opt == "--max-batch" && hasValue) options.maxBatch = max<size_t>(1, size_t(atol(argv[++arg])));
+        else if (opt == "--batch-window" && hasValue) options.batchWindow = chrono::microseconds(atol(argv[++arg]));
+        else if (opt == "--cache" && hasValue) options.cacheSize = size_t(atol(argv[++arg]));
+        else if (opt == "--dlx") options.backend = SolverBackend::DANCING_LINKS;
+        else {
+            printUsage();
+            return 2;
+        }
+    }
+    // A client that hangs up before its answers are written shouldn't stop the server.
+    signal(SIGPIPE, SIG_IGN);
+
+    ServerStats stats;
+    RequestQueue queue(options.maxQueued, stats);
+    ThreadPool pool(options.numThreads);
+    unique_ptr<SolutionCache> cache;
+    if (options.cacheSize > 0) {
+        cache = make_unique<SolutionCache>(options.cacheSize);
+    }
+
+    // Warm up every thread (and, for Dancing Links, build each one's matrix) before
+    // taking requests, so the first ones don't pay for it.  Each task waits for all the
+    // others to start, so no worker can run two and leave another cold.
+    mutex warmLock;
+    condition_variable allWarming;
+    unsigned warming = 0;
+    pool.forEach(pool.size(), [&](size_t, unsigned) {
+        {
+            unique_lock<mutex> lock(warmLock);
+            if (++warming == pool.size()) allWarming.notify_all();
+            else allWarming.wait(lock, [&] { return warming == pool.size(); });
+        }
+        uint8_t cells[SudokuPuzzle::NUM_SPOTS] = {};
+        SudokuPuzzle sp(cells);
+        sp.setBackend(options.backend);
+        sp.solveInto(cells);
+    }, 1);
+
+    thread dispatcher(dispatch, cref(options), ref(queue), ref(stats), ref(pool), cache.get());
+
+    int rc = 0;
+    if (!options.socketPath.empty()) {
+        rc = serveSocket(options.socketPath, queue, stats, pool) ? 0 : 1;
+    }
+    else {
+        // One client on stdin and stdout.
+        readRequests(make_shared<Connection>(STDIN_FILENO, STDOUT_FILENO), queue, stats, pool);
+    }
+    // Let the answers still queued go out, then report the counters.
+    queue.close();
+    dispatcher.join();
+    cerr << describeStats(stats, queue, pool);
+    return rc;
+}
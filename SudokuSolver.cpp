@@ -8,586 +8,246 @@
 //============================================================================
 
 #include <iostream>
-#include <fstream>
-#include <sstream>
-#include <set>
+#include <string>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
+#include <algorithm>
+#include "SudokuPuzzle.h"
+#include "ThreadPool.h"
+#include "SolutionCache.h"
+#include "PackedCorpus.h"
+#include "MultiPuzzleSolver.h"
+#include "SearchTrace.h"
 using namespace std;
 
-enum class RowOrCol {
-    ROW,
-    COL
-};
-
-class SudokuPuzzle {
-
-public:
-
-    // Constructor taking a 2D array of ints
-    SudokuPuzzle(const int potentialSolution[9][9]);
-
-    // Constructor taking a filename of a CSV file, with nine lines of ints,
-    // nine per line, each line representing a row of the puzzle board.
-    SudokuPuzzle(const string& fn);
-
-    // Copy constructor.  Not actually needed for this program to work, but
-    // included for completeness.
-    SudokuPuzzle(const SudokuPuzzle& from);
-
-    // Copy assignment operator.  Not actually needed for this program to work, but
-    // included for completeness.
-    SudokuPuzzle& operator=(const SudokuPuzzle& from);
-
-    // Move constructor.  Not actually needed for this program to work, but
-    // included for completeness.
-    SudokuPuzzle(SudokuPuzzle&& from);
-
-    // Move assignment operator.  Not actually needed for this program to work, but
-    // included for completeness.
-    SudokuPuzzle& operator=(SudokuPuzzle&& from);
-
-    ~SudokuPuzzle();
-
-    // Check the given puzzle to see if it is a valid solution.
-    // Return value:
-    //    true - The puzzle contains a valid solution.
-    //    false - The puzzle does NOT contain a valid solution.
-    bool isSolutionValid(const bool verbose = false) const;
-
-    // Solve an incomplete puzzle.
-    // Return value:
-    //    true - puzzle was solved
-    //    false - puzzle was not solved.  Either there is no valid solution or
-    //            the algorithm is insufficient (defective).
-    bool solve(const bool verbose = false);
-
-    // Get the value of specified location on the board.  Zero based indexing.
-    int getValue(const int row, const int col) const;
-
-    // Set the value of the specified location on the board to the specified value.
-    void setValue(const int row, const int col, const int value);
-
-private:
-    int board[9][9];
-
-    // For each blank spot on the board, a list of valid values for the current state of the
-    // puzzle.  A nullptr for each spot that already has its value set (non-zero).
-    set<int>* possibilities[9][9];
-
-    int minPossibilities;
-    int minRow;
-    int minCol;
-
-    // Not really part of the state of the puzzle.  Set by isSolutionValid.
-    // Used by several of the ...Ok methods.
-    mutable bool verbose = false;
-
-    bool isRowOrColOk(const int row, const RowOrCol which = RowOrCol::ROW) const;
-
-    bool isSubmatrixOk(const int startRowIdx, const int startColIdx) const;
-
-    bool areSubmatricesOk() const;
-
-    void print() const;
-
-    bool wouldWork(const int value, const int atRow, const int atCol);
-
-    void setAllPossibilities();
-
-    int trimPossibilities();
-
-    void listPossibilities() const;
-
-};
-
-SudokuPuzzle::SudokuPuzzle(const int potentialSolution[9][9]) {
-    // Initialize these three to something invalid, and in the case of
-    // minPossibilites, the number to beat (easy!)
-    minPossibilities = 10;
-    minRow = 10;
-    minCol = 10;
-    // Set the values of the board
-    for (int row=0; row < 9; row++) {
-        for (int col=0; col < 9; col++) {
-            board[row][col] = potentialSolution[row][col];
-        }
-    }
-
-    // Initialize possibilities to nullptr
-    for (int row=0; row < 9; row++) {
-        for (int col=0; col < 9; col++) {
-            possibilities[row][col] = nullptr;
-        }
-    }
-}
-
-SudokuPuzzle::SudokuPuzzle(const string &fn) {
-    // Initialize these three to something invalid, and in the case of
-    // minPossibilites, the number to beat (easy!)
-    minPossibilities = 10;
-    minRow = 10;
-    minCol = 10;
-    try {
-        ifstream infile(fn);
-        if (infile.good()) { // check for success opening file
-            string line;
-            int row = 0, col = 0;
-            // Read each line
-            while (getline(infile, line)) {
-                // Use getline on a stringstream to parse values between commas
-                string value;
-                stringstream lineStream(line);
-                while (getline(lineStream, value, ',')) {
-                    // Accept a space, empty string, or 0 as not filled in yet, but represent
-                    // it on the board as a zero.
-                    if (value == " " or value == "" or value == "0") {
-                        board[row][col] = 0;
-                    }
-                    else {
-                        board[row][col] = stoi(value);
-                    }
-                    col++;
-                }
-                // Done with the row.  Increment row and reset col to zero.
-                row++;
-                col = 0;
-            }
-        }
-        else {
-            cerr << "Failed to open file: " << fn << endl;
-        }
-    }
-    catch (std::exception& e) {
-        cerr << "Exception in constructor reading file.";
-    }
-
-    // Initialize possibilities to nullptr
-    for (int row=0; row < 9; row++) {
-        for (int col=0; col < 9; col++) {
-            possibilities[row][col] = nullptr;
-        }
-    }
-
-    print(); // for debug...
-}
-
-// Copy constructor
-SudokuPuzzle::SudokuPuzzle(const SudokuPuzzle& from) {
-    // Copy board values and possibilities
-    for (int row=0; row < 9; row++) {
-        for (int col=0; col < 9; col++) {
-            // Copy board value for this space
-            board[row][col] = from.board[row][col];
-
-            if (from.possibilities[row][col] == nullptr)
-                possibilities[row][col] = nullptr;
-            else {
-                // Create a new set and add all the possible values to it
-                possibilities[row][col] = new set<int>;
-                for (set<int>::iterator it = from.possibilities[minRow][minCol]->begin(); it != from.possibilities[minRow][minCol]->end(); it++) {
-                    possibilities[row][col]->insert(*it);
-                }
-            }
-        }
-    }
-
-    // Copy trivial values
-    minPossibilities = from.minPossibilities;
-    minRow = from.minRow;
-    minCol = from.minCol;
-    verbose = from.verbose;
-}
-
-// Copy assignment
-SudokuPuzzle& SudokuPuzzle::operator=(const SudokuPuzzle& from) {
-    // Copy board values and possibilities
-    for (int row=0; row < 9; row++) {
-        for (int col=0; col < 9; col++) {
-            // Copy board value for this space
-            board[row][col] = from.board[row][col];
-
-            // Delete the old possibilities
-            delete possibilities[row][col];
-
-            if (from.possibilities[row][col] == nullptr)
-                possibilities[row][col] = nullptr;
-            else {
-                // Create a new set and add all the possible values to it
-                possibilities[row][col] = new set<int>;
-                for (set<int>::iterator it = from.possibilities[minRow][minCol]->begin(); it != from.possibilities[minRow][minCol]->end(); it++) {
-                    possibilities[row][col]->insert(*it);
-                }
-            }
-        }
+// Solve the puzzle and, if that works, print the solution.
+template <typename Puzzle>
+bool solveAndPrint(Puzzle& sp) {
+    if (!sp.solve()) {
+        return false;
     }
-
-    // Copy trivial values
-    minPossibilities = from.minPossibilities;
-    minRow = from.minRow;
-    minCol = from.minCol;
-    verbose = from.verbose;
-
-    return *this;
-}
-
-// Move constructor
-SudokuPuzzle::SudokuPuzzle(SudokuPuzzle&& from)
-    :minPossibilities{from.minPossibilities},
-     minRow{from.minRow},
-     minCol{from.minCol},
-     verbose{from.verbose} {
-         // Copy board values and possibilities
-         for (int row=0; row < 9; row++) {
-             for (int col=0; col < 9; col++) {
-                 // Copy board value for this space
-                 board[row][col] = from.board[row][col];
-                 possibilities[row][col] = from.possibilities[row][col];
-                 from.possibilities[row][col] = nullptr;
-             }
-         }
+    cout << "Solution:" << endl;
+    sp.print();
+    return true;
 }
 
-// Move assignment operator.
-SudokuPuzzle& SudokuPuzzle::operator=(SudokuPuzzle&& from) {
-    // Copy board values and possibilities
-    for (int row=0; row < 9; row++) {
-        for (int col=0; col < 9; col++) {
-            // Delete the old possibilities
-            delete possibilities[row][col];
-
-            // Copy board value for this space
-            board[row][col] = from.board[row][col];
-            possibilities[row][col] = from.possibilities[row][col];
-            from.possibilities[row][col] = nullptr;
-        }
-    }
-    // Copy trivial values
-    minPossibilities = from.minPossibilities;
-    minRow = from.minRow;
-    minCol = from.minCol;
-    verbose = from.verbose;
-    return *this;
-}
+// Options for solving a stream of puzzles (--batch on the command line).
+struct BatchOptions {
+    // The file to read puzzles from.  Empty or "-" for stdin.  A packed corpus (see
+    // PackedCorpus.h) is read as such, whatever its name.
+    string inputFile;
+    // Zero for one thread per hardware thread.
+    unsigned numThreads = 0;
+    // Write each result as "index solution" as soon as it is ready, instead of
+    // writing results in input order.
+    bool unordered = false;
+    // The number of rows (and columns) of the puzzles: 4, 6, 8, 9, 12, 16 or 25.
+    int size = 9;
+    SolverBackend backend = SolverBackend::PROPAGATION;
+    // How many solutions to cache by canonical form, for 9x9 puzzles.  Zero for no cache.
+    size_t cacheSize = 0;
+    // Propagate 9x9 puzzles many at a time with solveMany(), searching only those
+    // that need it.  Ignored with a cache.
+    bool simd = false;
+    // Record each puzzle's search tree to this file, solving one at a time.
+    string traceFile;
+    TraceFormat traceFormat = TraceFormat::BINARY;
+};
 
-bool SudokuPuzzle::solve(const bool verbose) {
-    this->verbose = verbose;
-    // Initialize the list of possible values for each blank space to 1 through 9.  These
-    // lists will then be trimmed be checking to see which of the values are actually OK,
-    // and which aren't.
-    setAllPossibilities();
-    // Keep track of the number of blank spots in the previous iteration, so that we can
-    // detect no progress.  Initialize it to more than possible.
-    int prevNumBlank = 50;
-    while (true) {
-        int numBlank = trimPossibilities();
-        // Check for a return of -1, which indicates the puzzle can't be solved.
-        if (numBlank == -1) {
-            return false;  // Puzzle can't be solved.
-        }
-        // Check for the puzzle now being solved (no blanks left)
-        if (numBlank == 0) {
-            cout << "Solution:" << endl;
-            print();
-            return true;
-        }
-        if (numBlank == prevNumBlank) {
-
-            // First, let's try printing what the next space with the lowest number of possibilities is, and
-            // what that number is.
-            if (verbose) cout << "MinPossibilites: " << minPossibilities << ", minRow: " << minRow << ", minCol: " << minCol << endl;
-
-            // Iterate over that set of possibilities, creating a new puzzle with that value, and
-            // try to solve it (recursive call).
-            for (set<int>::iterator it = possibilities[minRow][minCol]->begin(); it != possibilities[minRow][minCol]->end(); it++) {
-                if (verbose) cout << "Creating sub-puzzle for value: " << *it << endl;
-
-                SudokuPuzzle* subPuzzle = new SudokuPuzzle(board); // based on current puzzle
-                subPuzzle->setValue(minRow, minCol, *it); // but with this value set to see how it works out
-
-                // If solved, copy values of the sub-puzzle into this one and return true.
-                if (subPuzzle->solve()) {
-                    for (int row=0; row < 9; row++) {
-                        for (int col=0; col < 9; col++) {
-                            // For all blanks in this puzzle, copy values from sub-puzzle
-                            if (board[row][col] == 0) board[row][col] = subPuzzle->getValue(row, col);
-                        }
-                    }
-                    // Delete the sub-puzzle
-                    delete subPuzzle;
-                    subPuzzle = nullptr;
-                    return true;
-                }
-                // That value didn't work out.  Delete the sub-puzzle.
-                delete subPuzzle;
-                subPuzzle = nullptr;
-            }
-            // If survive loop without a solution, return false
-            return false; // stuck
-        }
-        prevNumBlank = numBlank;
-    } // end while loop
-}
+// One puzzle in the batch being solved, and its result.
+template <int SIZE>
+struct BatchItem {
+    uint8_t cells[SIZE * SIZE];
+    SolveStatus status;
+};
 
-int SudokuPuzzle::getValue(const int row, const int col) const {
-    return board[row][col];
+// Append the result for one puzzle to out: the values of the solution, or
+// "unsolvable" or "invalid".  In unordered mode the line starts with the index of
+// the puzzle in the input, counting from zero.
+template <int SIZE>
+void appendBatchResult(string& out, const BatchItem<SIZE>& item, const size_t index, const bool withIndex) {
+    if (withIndex) {
+        out += to_string(index);
+        out += ' ';
+    }
+    switch (item.status) {
+    case SolveStatus::SOLVED:
+        for (int idx=0; idx < SIZE * SIZE; idx++) out += valueToChar(item.cells[idx]);
+        break;
+    case SolveStatus::UNSOLVABLE:
+        out += "unsolvable";
+        break;
+    case SolveStatus::INVALID:
+        out += "invalid";
+        break;
+    }
+    out += '\n';
 }
 
-void SudokuPuzzle::setValue(const int row, const int col, const int value) {
-    board[row][col] = value;
+// Whether the batch input is a packed corpus rather than text.
+bool isPackedInput(const BatchOptions& options) {
+    return !options.inputFile.empty() && options.inputFile != "-" && PackedCorpus::isPacked(options.inputFile);
 }
 
-SudokuPuzzle::~SudokuPuzzle() {
-    for (int row=0; row < 9; row++) {
-        for (int col=0; col < 9; col++) {
-            if (possibilities[row][col]) {
-                delete possibilities[row][col];
-                possibilities[row][col] = nullptr;
-            }
-        }
-    }
-}
-
-// Check the row of the puzzle to make sure each entry in the row is both
-// unique and a valid value (int 0 - 9 only, zero being used to represent blank),
-//                        OR
-// Check the column of the puzzle for uniqueness.
-//
-// Return value:
-//    true - The row (or col) is OK
-//    false - The row (or col) is NOT OK.  There is either an invalid value  or a
-//            duplicate within the row (or col).
-bool SudokuPuzzle::isRowOrColOk(const int row, const RowOrCol which) const {
-    // Check row for valid and non-repeating values.  The non-repeating
-    // aspect will be done by using a set and adding the values to the
-    // set, checking for a return code indicating the value to be added
-    // already exists.
-    set<int> values;
-
-    // Check the row to make sure it doesn't have any duplicates
-    values.clear();
-    for (int col = 0; col < 9; col++) {
-        int value;
-
-        // If we're checking a row, grab the value using indices as expected, but
-        // if we're checking a column, switch the indices.  This lets us check
-        // either with one method instead of two nearly identical methods.
-        if (which == RowOrCol::ROW) value = board[row][col];
-        else value = board[col][row];
-
-        // Check uniqueness
-        if (value != 0) {
-            auto rc = values.insert(value);
-            if (!rc.second) { // If insert not successful due to value already being in set
-                if (verbose) {
-                    // Do the appropriate message depending on if we're checking rows or columns
-                    if (which == RowOrCol::ROW) cout << "row " << row << " has a repeat value: " << value << endl;
-                    else cout << "col " << row << " has a repeat value: " << value << endl;
-                    // Yes, we really want to use the row variable in the line above, since in the
-                    // case of checking columns, the meanings of the row and col variables are reversed.
-                }
-                return false;
-            }
-        }
-    }
-    if (verbose) {
-        // Do the appropriate message depending on if we're checking rows or columns
-        if (which == RowOrCol::ROW) cout << "row " << row << " is OK." << endl;
-        else cout << "col " << row << " is OK." << endl;
-        // Yes, we really want to use the row variable in the line above, since in the
-        // case of checking columns, the meanings of the row and col variables are reversed.
+// Whether every value is blank or 1 - SIZE.  Text input is checked as it's parsed, but
+// 4 bits can hold values too big for a 9x9 puzzle.
+template <int SIZE>
+bool valuesInRange(const uint8_t (&cells)[SIZE * SIZE]) {
+    for (int idx=0; idx < SIZE * SIZE; idx++) {
+        if (cells[idx] > SIZE) return false;
     }
     return true;
 }
 
-// Check the specified submatrix of the puzzle to make sure each entry in the submatrix is unique.
+// Solve every puzzle from the input on a pool of worker threads, writing one line per
+// puzzle to stdout.  Puzzles are read and solved in chunks, so the input can be
+// arbitrarily long.  Malformed puzzles are reported on stderr by line number.
 // Return value:
-//    true - The submatrix is OK
-//    false - The submatrix are NOT OK.  There is a duplicate within the submatrix.
-bool SudokuPuzzle::isSubmatrixOk(const int startRowIdx, const int startColIdx) const {
-    set<int> values;
-    int stopRowIdx = startRowIdx + 3; // Stop indices are exclusive
-    int stopColIdx = startColIdx + 3;
-    for (int row = startRowIdx; row < stopRowIdx; row++) {
-        for (int col = startColIdx; col < stopColIdx; col++) {
-            int value = board[row][col];
-            if (value != 0) {
-                auto rc = values.insert(value);
-                if (!rc.second) {
-                    if (verbose) cout << "Submatrix with starting row " << startRowIdx <<
-                        " and starting column " << startColIdx << " has a repeat value: " << value << endl;
-                    return false;
-                }
+//    0 - every puzzle was solved
+//    1 - some puzzles were invalid or unsolvable, or the input couldn't be opened
+template <typename Puzzle>
+int runBatch(const BatchOptions& options) {
+    constexpr int SIZE = Puzzle::SIZE;
+    typedef BatchItem<SIZE> Item;
+
+    LineSource source;
+    PackedCorpus packed;
+    const bool isPacked = isPackedInput(options);
+    if (isPacked && !packed.open(options.inputFile)) {
+        cerr << options.inputFile << ": " << packed.error() << endl;
+        return 1;
+    }
+    if (!isPacked && !source.open(options.inputFile)) {
+        cerr << "Failed to open file: " << options.inputFile << endl;
+        return 1;
+    }
+    ios::sync_with_stdio(false);
+
+    const size_t CHUNK_SIZE = 8192;
+    ThreadPool pool(options.numThreads);
+    unique_ptr<SolutionCache> cache;
+    if (SIZE == 9 && options.cacheSize > 0) {
+        cache = make_unique<SolutionCache>(options.cacheSize);
+    }
+    PuzzleReader<SIZE> reader(source);
+    vector<Item> items(CHUNK_SIZE);
+    vector<string> threadOutput(pool.size());
+    mutex outputMutex;
+    string output;
+    ParseError error;
+    size_t firstIndex = 0;
+    size_t numFailed = 0;
+    bool more = true;
+
+    while (more) {
+        size_t count = 0;
+        while (count < CHUNK_SIZE && (more = isPacked ? packed.next(items[count].cells)
+                                                      : reader.next(items[count].cells, error))) {
+            if (!error.ok()) {
+                cerr << describe(error) << endl;
+                items[count].status = SolveStatus::INVALID;
             }
-        }
-    }
-    if (verbose) cout << "Submatrix with starting row " << startRowIdx << " and starting column " <<
-        startColIdx << " is OK." << endl;
-    return true;
-}
-
-// Check the submatrices of the puzzle to make sure each entry in each submatrix is unique.
-// Return value:
-//    true - The submatrices are OK
-//    false - The submatrices are NOT OK.  There is a duplicate within one or more submatrix.
-bool SudokuPuzzle::areSubmatricesOk() const {
-    // Check sub-matrices (the 9 3x3 squares)
-    for (int startRow = 0; startRow < 7; startRow += 3) {
-        for (int startCol = 0; startCol < 7; startCol += 3) {
-            if (!isSubmatrixOk(startRow, startCol))
-                return false;
-        }
-    }
-    return true;
-}
-
-
-bool SudokuPuzzle::isSolutionValid(bool verbose) const {
-    this->verbose = verbose;
-    // Check rows
-    for (int row = 0; row < 9; row++) {
-        if (!isRowOrColOk(row)) // ROW is default
-            return false;
-    }
-    // Check columns
-    for (int col = 0; col < 9; col++) {
-        if (!isRowOrColOk(col, RowOrCol::COL))
-            return false;
-    }
-    return areSubmatricesOk();
-}
-
-// Print the contents of the puzzle to stdout.
-void SudokuPuzzle::print() const {
-    cout << "-------------------------------------" << endl;
-    for (int row=0; row < 9; row++) {
-        cout << "|";
-        for (int col=0; col < 9; col++) {
-            if (board[row][col] == 0) cout << "   |";
-            else cout << " " << board[row][col] << " |";
-        }
-        cout << endl;
-        cout << "-------------------------------------" << endl;
-    }
-}
-
-// See if the given value would be valid in the given spot.
-// Return value:
-//    true - it would work
-//    false - it wouldn't
-bool SudokuPuzzle::wouldWork(const int value, const int atRow, const int atCol) {
-    board[atRow][atCol] = value;
-    if (!isRowOrColOk(atRow)) {
-        board[atRow][atCol] = 0;
-        return false;
-    }
-    if (!isRowOrColOk(atCol, RowOrCol::COL)) {
-        board[atRow][atCol] = 0;
-        return false;
-    }
-    if (isSubmatrixOk(3 * (atRow / 3), 3 * (atCol / 3))) {
-        board[atRow][atCol] = 0;
-        return true;
-    }
-    else {
-        board[atRow][atCol] = 0;
-        return false;
-    }
-}
-
-// For every blank space on the board, set the list of possibilities to all
-// numbers 1 - 9.  The list will then be trimmed of those that don't work.
-void SudokuPuzzle::setAllPossibilities() {
-    for (int row=0; row < 9; row++) {
-        for (int col=0; col < 9; col++) {
-            if (board[row][col] == 0) {
-                possibilities[row][col] = new set<int> {1, 2, 3, 4, 5, 6, 7, 8, 9};
+            else if (isPacked && !valuesInRange<SIZE>(items[count].cells)) {
+                cerr << "puzzle " << firstIndex + count << ": invalid value" << endl;
+                items[count].status = SolveStatus::INVALID;
             }
             else {
-                possibilities[row][col] = nullptr;
+                items[count].status = SolveStatus::UNSOLVABLE;
             }
+            count++;
         }
-    }
-}
 
-// Trim the list of possibilities for each blank space to those that would actually
-// work.  In those cases where the list ends up being length 1, we know the proper
-// value for that spot, so go ahead and set it.
-// Return value:
-//    The number of spots that are still blank (should be between 0 and 81)
-int SudokuPuzzle::trimPossibilities() {
-    // Initialize these three to something invalid, and in the case of
-    // minPossibilites, the number to beat (easy!)
-    minPossibilities = 10;
-    minRow = 10;
-    minCol = 10;
-    if (verbose) print();
-    int numBlank = 0;
-
-    for (int row=0; row < 9; row++) {
-        for (int col=0; col < 9; col++) {
-            if (possibilities[row][col]) {
-                // Iterate over the set of possible numbers, and check each to see if it would actually work.
-                for (auto it = possibilities[row][col]->begin(); it != possibilities[row][col]->end();) {
-                    if (!wouldWork(*it, row, col)) {
-                        // Remove it, since it wouldn't work
-                        it = possibilities[row][col]->erase(it);
-                    }
-                    else it++;
+        auto emitUnordered = [&](size_t idx, unsigned worker) {
+            string& out = threadOutput[worker];
+            appendBatchResult(out, items[idx], firstIndex + idx, true);
+            if (out.size() >= 65536) {
+                lock_guard<mutex> lock(outputMutex);
+                fwrite(out.data(), 1, out.size(), stdout);
+                out.clear();
+            }
+        };
+
+        if (SIZE == 9 && options.simd && !cache) {
+            // Hand each worker a group of puzzles to solve together.
+            const size_t GROUP_SIZE = 64;
+            pool.forEach((count + GROUP_SIZE - 1) / GROUP_SIZE, [&](size_t group, unsigned worker) {
+                const size_t first = group * GROUP_SIZE;
+                const size_t num = min(GROUP_SIZE, count - first);
+                uint8_t grids[GROUP_SIZE * SIZE * SIZE];
+                SolveStatus statuses[GROUP_SIZE];
+                for (size_t idx=0; idx < num; idx++) {
+                    memcpy(grids + idx * SIZE * SIZE, items[first + idx].cells, SIZE * SIZE);
                 }
-                // If verbose, List the possibilities
-                if (verbose) {
-                    cout << "Number of possibilities for row " << row << ", col " << col << ": " <<
-                        possibilities[row][col]->size() << " (";
-                    for (auto it = possibilities[row][col]->begin(); it != possibilities[row][col]->end(); it++) {
-                        cout << *it << " ";
+                solveMany(grids, num, grids, statuses, options.backend);
+                for (size_t idx=0; idx < num; idx++) {
+                    Item& item = items[first + idx];
+                    if (item.status != SolveStatus::INVALID) {
+                        item.status = statuses[idx];
+                        memcpy(item.cells, grids + idx * SIZE * SIZE, SIZE * SIZE);
                     }
-                    cout << ")" << endl;
+                    if (options.unordered) emitUnordered(first + idx, worker);
                 }
-                if (possibilities[row][col]->size() == 0) {
-                    // There are no possible values for this spot.  Puzzle can't be solved.
-                    return -1;
+            });
+        }
+        else {
+            pool.forEach(count, [&](size_t idx, unsigned worker) {
+                Item& item = items[idx];
+                if (item.status != SolveStatus::INVALID && cache) {
+                    if constexpr (SIZE == 9) item.status = cache->solve(item.cells, item.cells, options.backend);
                 }
-                // If there is only one possible value that works for this space, set it to that
-                // value and continue!
-                if (possibilities[row][col]->size() == 1) {
-                    if (verbose) cout << "***** Gonna set it to " << *(possibilities[row][col]->begin()) << endl;
-                    board[row][col] = *(possibilities[row][col]->begin());
-                    delete possibilities[row][col];
-                    possibilities[row][col] = nullptr;
-                }
-                else {
-                    numBlank++; // Count this spot that is still blank
-
-                    // See if this list is shorter than the shortest so far, and if so, keep it as
-                    // the new shortest.
-                    if (int(possibilities[row][col]->size()) < minPossibilities) {
-                        minPossibilities = possibilities[row][col]->size();
-                        minRow = row;
-                        minCol = col;
-                    }
+                else if (item.status != SolveStatus::INVALID) {
+                    Puzzle sp(item.cells);
+                    sp.setBackend(options.backend);
+                    item.status = sp.solveInto(item.cells);
                 }
+                if (options.unordered) emitUnordered(idx, worker);
+            });
+        }
+
+        for (size_t idx=0; idx < count; idx++) {
+            if (items[idx].status != SolveStatus::SOLVED) numFailed++;
+            if (!options.unordered) appendBatchResult(output, items[idx], firstIndex + idx, false);
+        }
+        if (options.unordered) {
+            for (string& out : threadOutput) {
+                fwrite(out.data(), 1, out.size(), stdout);
+                out.clear();
             }
         }
+        else {
+            fwrite(output.data(), 1, output.size(), stdout);
+            output.clear();
+        }
+        firstIndex += count;
+    }
+    fflush(stdout);
+    cerr << "Solved " << (firstIndex - numFailed) << " of " << firstIndex << " puzzles using " <<
+        pool.size() << " threads." << endl;
+    if (cache) {
+        cerr << "Cache: " << cache->hits() << " hits, " << cache->misses() << " misses, " <<
+            cache->skipped() << " too sparse or symmetric to look up." << endl;
     }
-    if (verbose) cout << "trimPossibilites returning " << numBlank << endl;
-    return numBlank;
+    return numFailed == 0 ? 0 : 1;
 }
 
-// Print out the list of possibilities for each spot
-void SudokuPuzzle::listPossibilities() const {
-    for (int row=0; row < 9; row++) {
-        for (int col=0; col < 9; col++) {
-            if (possibilities[row][col] != nullptr) {
-                cout << "For row " << row << ", col " << col << ", possibilities are: ";
-                for (auto it = possibilities[row][col]->begin(); it != possibilities[row][col]->end(); it++) {
-                    cout << *it << " ";
-                }
-                cout << endl;
-            }
-        }
+// Read a puzzle file for the demo and print it, reporting anything wrong with the file.
+template <typename Puzzle = SudokuPuzzle>
+Puzzle loadPuzzle(const string& fn) {
+    ParseError error;
+    Puzzle sp(fn, &error);
+    if (!error.ok()) {
+        cerr << fn << ": " << describe(error) << endl;
     }
+    sp.print();
+    return sp;
 }
 
-int main() {
+// Check and solve the example puzzles, printing the results.
+void runDemo() {
 
     {
         // A solution to be tested that passes the row and column
@@ -656,44 +316,212 @@ int main() {
     }
 
     {
-        SudokuPuzzle sp("solvedPuzzle.txt");
+        SudokuPuzzle sp = loadPuzzle("solvedPuzzle.txt");
         cout << "Solution to solvedPuzzle is " << (sp.isSolutionValid() ? "" : "NOT ") << "valid." << endl;
     }
 
     {
-        SudokuPuzzle sp("easyPuzzle.txt");
+        SudokuPuzzle sp = loadPuzzle("easyPuzzle.txt");
         cout << "So far easyPuzzle is " << (sp.isSolutionValid() ? "" : "NOT ") << "valid." << endl;
-        sp.solve();
+        solveAndPrint(sp);
     }
 
     {
-        SudokuPuzzle sp("hardPuzzle.txt");
+        SudokuPuzzle sp = loadPuzzle("hardPuzzle.txt");
         cout << "So far hardPuzzle is " << (sp.isSolutionValid() ? "" : "NOT ") << "valid." << endl;
-        sp.solve();
+        solveAndPrint(sp);
         cout << "Computed solution to hardPuzzle is " << (sp.isSolutionValid() ? "" : "NOT ") << "valid." << endl;
     }
 
     {
-        SudokuPuzzle sp("UnitedSudoku1.txt");
+        SudokuPuzzle sp = loadPuzzle("UnitedSudoku1.txt");
         cout << "So far UnitedSudoku1 is " << (sp.isSolutionValid() ? "" : "NOT ") << "valid." << endl;
-        sp.solve();
+        solveAndPrint(sp);
         cout << "Computed solution to UnitedSudoku1 is " << (sp.isSolutionValid() ? "" : "NOT ") << "valid." << endl;
     }
 
     {
-        SudokuPuzzle sp("UnitedSudoku2.txt");
+        SudokuPuzzle sp = loadPuzzle("UnitedSudoku2.txt");
         cout << "So far UnitedSudoku2 is " << (sp.isSolutionValid() ? "" : "NOT ") << "valid." << endl;
-        sp.solve();
+        solveAndPrint(sp);
         cout << "Computed solution to UnitedSudoku2 is " << (sp.isSolutionValid() ? "" : "NOT ") << "valid." << endl;
     }
 
     {
+        // Follow this one step by step.
         string fn = "DavesHardPuzzle.txt";
-        SudokuPuzzle sp(fn);
+        auto sp = loadPuzzle<BasicSudokuPuzzle<3, 3, ConsoleTrace>>(fn);
         cout << "So far " << fn << " is " << (sp.isSolutionValid() ? "" : "NOT ") << "valid." << endl;
-        sp.solve(true);
+        solveAndPrint(sp);
         cout << "Computed solution to " << fn << " is " << (sp.isSolutionValid() ? "" : "NOT ") << "valid." << endl;
+        const SolverStats& stats = sp.getStats();
+        cout << "Guesses: " << stats.guesses << ", backtracks: " << stats.backtracks << ", max depth: " <<
+            stats.maxDepth << ", propagation passes: " << stats.propagationPasses << ", possibilities eliminated: " <<
+            stats.candidatesEliminated << endl;
+    }
+
+}
+
+// Solve every puzzle from the input (text or packed, as for runBatch()) one at a time on
+// this thread, recording the search tree of each to options.traceFile as tree number
+// (index in the input), and write one line per puzzle to stdout as runBatch() does.
+// Return value: as for runBatch()
+template <typename Puzzle>
+int runTraced(const BatchOptions& options) {
+    constexpr int SIZE = Puzzle::SIZE;
+    LineSource source;
+    PackedCorpus packed;
+    const bool isPacked = isPackedInput(options);
+    if (isPacked && !packed.open(options.inputFile)) {
+        cerr << options.inputFile << ": " << packed.error() << endl;
+        return 1;
+    }
+    if (!isPacked && !source.open(options.inputFile)) {
+        cerr << "Failed to open file: " << options.inputFile << endl;
+        return 1;
+    }
+    SearchTraceWriter writer;
+    if (!writer.open(options.traceFile, options.traceFormat)) {
+        cerr << "Failed to create file: " << options.traceFile << endl;
+        return 1;
+    }
+    ios::sync_with_stdio(false);
+
+    PuzzleReader<SIZE> reader(source);
+    BatchItem<SIZE> item;
+    ParseError error;
+    string output;
+    size_t index = 0;
+    size_t numFailed = 0;
+    while (isPacked ? packed.next(item.cells) : reader.next(item.cells, error)) {
+        // Every puzzle gets a tree, so tree numbers match input order.
+        Puzzle sp(item.cells);
+        sp.setBackend(options.backend);
+        writer.beginTree(sp.getStats());
+        if (!error.ok()) {
+            cerr << describe(error) << endl;
+            item.status = SolveStatus::INVALID;
+        }
+        else if (isPacked && !valuesInRange<SIZE>(item.cells)) {
+            cerr << "puzzle " << index << ": invalid value" << endl;
+            item.status = SolveStatus::INVALID;
+        }
+        else {
+            item.status = sp.solveInto(item.cells);
+        }
+        writer.endTree();
+        if (item.status != SolveStatus::SOLVED) numFailed++;
+        appendBatchResult(output, item, index++, options.unordered);
+        if (output.size() >= 65536) {
+            fwrite(output.data(), 1, output.size(), stdout);
+            output.clear();
+        }
+    }
+    fwrite(output.data(), 1, output.size(), stdout);
+    fflush(stdout);
+    if (!writer.close()) {
+        cerr << "Failed to write file: " << options.traceFile << endl;
+        return 1;
+    }
+    cerr << "Solved " << (index - numFailed) << " of " << index << " puzzles, search trees in " <<
+        options.traceFile << "." << endl;
+    return numFailed == 0 ? 0 : 1;
+}
+
+void printUsage() {
+    cerr << "Usage: SudokuSolver                 Check and solve the example puzzles" << endl;
+    cerr << "       SudokuSolver --batch [options] [file]" << endl;
+    cerr << "Solve a stream of puzzles from file (or stdin), one line of output per puzzle." << endl;
+    cerr << "The file may be text or a packed corpus made by SudokuPack." << endl;
+    cerr << "  --threads N   Number of worker threads (default: one per hardware thread)" << endl;
+    cerr << "  --unordered   Write \"index solution\" as puzzles are solved, not in input order" << endl;
+    cerr << "  --size N      Puzzles are N x N: 4, 6, 8, 9 (default), 12, 16 or 25" << endl;
+    cerr << "  --dlx         Solve with Dancing Links instead of propagation and guessing" << endl;
+    cerr << "  --cache N     Remember up to N solutions by canonical form (9x9 only)" << endl;
+    cerr << "  --simd        Propagate many puzzles at once in SIMD lanes (9x9 only)" << endl;
+    cerr << "  --trace FILE  Solve one at a time, recording each search tree to FILE" << endl;
+    cerr << "  --trace-json  Write the trace as JSON lines instead of binary" << endl;
+}
+
+// Run the batch with puzzles of the given box size, traced if asked for.
+template <int BOX_ROWS, int BOX_COLS>
+int runBatchWithBoxes(const BatchOptions& options) {
+    if (!options.traceFile.empty()) {
+        return runTraced<BasicSudokuPuzzle<BOX_ROWS, BOX_COLS, RecordTrace>>(options);
+    }
+    return runBatch<BasicSudokuPuzzle<BOX_ROWS, BOX_COLS>>(options);
+}
+
+// Run the batch with the puzzle type for options.size.  Boxes are as wide as they
+// are high where possible, and otherwise one row shorter than they are wide.
+int runBatchForSize(const BatchOptions& options) {
+    switch (options.size) {
+    case 4: return runBatchWithBoxes<2, 2>(options);
+    case 6: return runBatchWithBoxes<2, 3>(options);
+    case 8: return runBatchWithBoxes<2, 4>(options);
+    case 9: return runBatchWithBoxes<3, 3>(options);
+    case 12: return runBatchWithBoxes<3, 4>(options);
+    case 16: return runBatchWithBoxes<4, 4>(options);
+    case 25: return runBatchWithBoxes<5, 5>(options);
+    default:
+        printUsage();
+        return 2;
     }
+}
 
-    return 0;
+int main(int argc, char* argv[]) {
+    if (argc == 1) {
+        runDemo();
+        return 0;
+    }
+
+    BatchOptions options;
+    bool batch = false;
+    for (int arg=1; arg < argc; arg++) {
+        string opt = argv[arg];
+        if (opt == "--batch") {
+            batch = true;
+        }
+        else if (opt == "--unordered") {
+            options.unordered = true;
+        }
+        else if (opt == "--dlx") {
+            options.backend = SolverBackend::DANCING_LINKS;
+        }
+        else if (opt == "--trace" && arg + 1 < argc) {
+            options.traceFile = argv[++arg];
+        }
+        else if (opt == "--trace-json") {
+            options.traceFormat = TraceFormat::JSON_LINES;
+        }
+        else if (opt == "--simd") {
+            options.simd = true;
+        }
+        else if (opt == "--cache" && arg + 1 < argc) {
+            options.cacheSize = size_t(atol(argv[++arg]));
+        }
+        else if (opt == "--threads" && arg + 1 < argc) {
+            options.numThreads = unsigned(atoi(argv[++arg]));
+        }
+        else if (opt == "--size" && arg + 1 < argc) {
+            options.size = atoi(argv[++arg]);
+        }
+        else if (opt == "-" || opt[0] != '-') {
+            options.inputFile = opt;
+        }
+        else {
+            printUsage();
+            return 2;
+        }
+    }
+    if (!batch) {
+        printUsage();
+        return 2;
+    }
+    if (isPackedInput(options)) {
+        // The size of a packed corpus is in its header.
+        PackedCorpus corpus;
+        if (corpus.open(options.inputFile)) options.size = corpus.gridSize();
+    }
+    return runBatchForSize(options);
 }
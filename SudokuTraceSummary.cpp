@@ -0,0 +1,214 @@
+//============================================================================
+// Name        : SudokuTraceSummary.cpp
+// Author      : Jeff Hancock
+//               https://www.linkedin.com/in/jeffreythancock/
+// Copyright   : Carte blanche.  Plagiarize at will.
+// Description : Summarises a search trace written by SudokuSolver --trace:
+//               the slowest puzzles, the subtrees they spent their time in,
+//               and how nodes and time are spread over the depths.  Or
+//               writes it out as folded stacks for a flame graph.
+//============================================================================
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <algorithm>
+#include <cstdio>
+#include <cstdint>
+#include "SearchTrace.h"
+using namespace std;
+
+// A trace record along with what's worked out from the records below it.
+struct TraceNode {
+    TraceRecord record;
+    // The index of the parent in the list of nodes, or -1 for a root.
+    long parent = -1;
+    // Nodes in the subtree, counting this one.
+    long subtreeNodes = 1;
+    // Time spent in this node itself: its time less its children's.
+    uint64_t selfNs = 0;
+    uint64_t childNs = 0;
+
+    uint64_t totalNs() const {
+        return record.endNs - record.startNs;
+    }
+};
+
+// The guess a node made, e.g. "r4c5=3", or "tree2" for the root of tree 2.
+string frameName(const TraceRecord& record) {
+    if (record.depth == 0) return "tree" + to_string(record.tree);
+    return "r" + to_string(record.row) + "c" + to_string(record.col) + "=" + to_string(record.value);
+}
+
+// Link each record to its parent and add up the subtrees.  Children are written before
+// their parents, so one pass in file order sees each subtree complete before its root.
+vector<TraceNode> buildTree(const vector<TraceRecord>& records) {
+    vector<TraceNode> nodes(records.size());
+    unordered_map<uint64_t, long> byId;
+    for (size_t idx=0; idx < records.size(); idx++) {
+        nodes[idx].record = records[idx];
+        byId[(uint64_t(records[idx].tree) << 32) | records[idx].node] = long(idx);
+    }
+    for (size_t idx=0; idx < nodes.size(); idx++) {
+        TraceNode& node = nodes[idx];
+        if (node.record.depth > 0) {
+            auto found = byId.find((uint64_t(node.record.tree) << 32) | node.record.parent);
+            if (found != byId.end()) node.parent = found->second;
+        }
+        node.selfNs = node.totalNs() > node.childNs ? node.totalNs() - node.childNs : 0;
+        if (node.parent >= 0) {
+            nodes[size_t(node.parent)].subtreeNodes += node.subtreeNodes;
+            nodes[size_t(node.parent)].childNs += node.totalNs();
+        }
+    }
+    return nodes;
+}
+
+// Write one line per node with time of its own: the path of guesses from the root,
+// separated by semicolons, and the nanoseconds spent there.
+void writeFolded(const vector<TraceNode>& nodes) {
+    string line;
+    vector<string> frames;
+    for (const TraceNode& node : nodes) {
+        if (node.selfNs == 0) continue;
+        frames.clear();
+        for (long idx = long(&node - nodes.data()); idx >= 0; idx = nodes[size_t(idx)].parent) {
+            frames.push_back(frameName(nodes[size_t(idx)].record));
+        }
+        line.clear();
+        for (auto frame = frames.rbegin(); frame != frames.rend(); ++frame) {
+            if (!line.empty()) line += ';';
+            line += *frame;
+        }
+        line += ' ';
+        line += to_string(node.selfNs);
+        line += '\n';
+        fwrite(line.data(), 1, line.size(), stdout);
+    }
+}
+
+void writeSummary(const vector<TraceNode>& nodes, const size_t top) {
+    vector<const TraceNode*> roots;
+    for (const TraceNode& node : nodes) {
+        if (node.record.depth == 0) roots.push_back(&node);
+    }
+    if (roots.empty()) {
+        cout << "No search trees in the trace.\n";
+        return;
+    }
+    unordered_map<uint32_t, uint64_t> treeNs;
+    for (const TraceNode* root : roots) treeNs[root->record.tree] = root->totalNs();
+
+    // The slowest puzzles, against the median.
+    vector<const TraceNode*> byTime = roots;
+    sort(byTime.begin(), byTime.end(), [](const TraceNode* a, const TraceNode* b) { return a->totalNs() > b->totalNs(); });
+    const double medianUs = byTime[byTime.size() / 2]->totalNs() / 1e3;
+    printf("%zu trees, %zu nodes, median tree %.1fus\n\n", roots.size(), nodes.size(), medianUs);
+    printf("Slowest trees:\n");
+    printf("  %6s %12s %10s %10s\n", "tree", "time (us)", "x median", "nodes");
+    for (size_t idx=0; idx < min(top, byTime.size()); idx++) {
+        const TraceNode& root = *byTime[idx];
+        printf("  %6u %12.1f %10.1f %10ld\n", root.record.tree, root.totalNs() / 1e3,
+               medianUs > 0 ? root.totalNs() / 1e3 / medianUs : 0.0, root.subtreeNodes);
+    }
+
+    // Where the time went below the roots.
+    vector<const TraceNode*> hot;
+    for (const TraceNode& node : nodes) {
+        if (node.record.depth > 0) hot.push_back(&node);
+    }
+    sort(hot.begin(), hot.end(), [](const TraceNode* a, const TraceNode* b) { return a->totalNs() > b->totalNs(); });
+    printf("\nHottest subtrees:\n");
+    printf("  %6s %8s %6s %-10s %-10s %10s %12s %8s\n", "tree", "node", "depth", "guess", "outcome", "nodes",
+           "time (us)", "of tree");
+    for (size_t idx=0; idx < min(top, hot.size()); idx++) {
+        const TraceNode& node = *hot[idx];
+        const uint64_t total = treeNs[node.record.tree];
+        printf("  %6u %8u %6u %-10s %-10s %10ld %12.1f %7.1f%%\n", node.record.tree, node.record.node,
+               unsigned(node.record.depth), frameName(node.record).c_str(), traceOutcomeName(node.record.outcome),
+               node.subtreeNodes, node.totalNs() / 1e3, total > 0 ? 100.0 * double(node.totalNs()) / double(total) : 0.0);
+    }
+
+    // Nodes and time at each depth.
+    struct Level {
+        long nodes = 0;
+        long deadEnds = 0;
+        uint64_t selfNs = 0;
+        uint64_t eliminated = 0;
+    };
+    vector<Level> levels;
+    for (const TraceNode& node : nodes) {
+        if (node.record.depth >= levels.size()) levels.resize(node.record.depth + 1);
+        Level& level = levels[node.record.depth];
+        level.nodes++;
+        if (node.record.outcome == TraceOutcome::DEAD_END) level.deadEnds++;
+        level.selfNs += node.selfNs;
+        level.eliminated += node.record.eliminated;
+    }
+    printf("\nBy depth:\n");
+    printf("  %6s %10s %10s %12s %12s %14s\n", "depth", "nodes", "dead ends", "time (us)", "us / node", "eliminated");
+    for (size_t depth=0; depth < levels.size(); depth++) {
+        const Level& level = levels[depth];
+        if (level.nodes == 0) continue;
+        printf("  %6zu %10ld %10ld %12.1f %12.2f %14llu\n", depth, level.nodes, level.deadEnds, level.selfNs / 1e3,
+               level.selfNs / 1e3 / double(level.nodes), (unsigned long long)level.eliminated);
+    }
+}
+
+void printUsage() {
+    cerr << "Usage: SudokuTraceSummary [options] TRACE" << endl;
+    cerr << "Summarise a search trace written by SudokuSolver --trace (binary or JSON lines)." << endl;
+    cerr << "  --top N       How many trees and subtrees to list (default: 10)" << endl;
+    cerr << "  --tree N      Only look at tree N (the Nth puzzle, from zero)" << endl;
+    cerr << "  --folded      Write folded stacks for flamegraph.pl instead, in nanoseconds" << endl;
+}
+
+int main(int argc, char* argv[]) {
+    string traceFile;
+    size_t top = 10;
+    long onlyTree = -1;
+    bool folded = false;
+    for (int arg=1; arg < argc; arg++) {
+        string opt = argv[arg];
+        if (opt == "--top" && arg + 1 < argc) {
+            top = size_t(atol(argv[++arg]));
+        }
+        else if (opt == "--tree" && arg + 1 < argc) {
+            onlyTree = atol(argv[++arg]);
+        }
+        else if (opt == "--folded") {
+            folded = true;
+        }
+        else if (opt[0] != '-' && traceFile.empty()) {
+            traceFile = opt;
+        }
+        else {
+            printUsage();
+            return 2;
+        }
+    }
+    if (traceFile.empty()) {
+        printUsage();
+        return 2;
+    }
+
+    vector<TraceRecord> records;
+    if (!readSearchTrace(traceFile, records)) {
+        cerr << traceFile << ": not a readable search trace" << endl;
+        return 1;
+    }
+    if (onlyTree >= 0) {
+        records.erase(remove_if(records.begin(), records.end(),
+                                [&](const TraceRecord& record) { return long(record.tree) != onlyTree; }),
+                      records.end());
+    }
+    vector<TraceNode> nodes = buildTree(records);
+    if (folded) {
+        writeFolded(nodes);
+    }
+    else {
+        writeSummary(nodes, top);
+    }
+    return 0;
+}
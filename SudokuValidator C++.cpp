@@ -8,123 +8,181 @@
 //               In the interview, I was asked to verbally describe how I would
 //               solve the problem of validating a potential solution to a
 //               Sudoku puzzle.  As an exercise, I later implemented it in C++.
+//               The checking itself is findViolations() in GridValidator.h,
+//               which reports every problem with a grid in a single pass.
+//               Given a file (or - for stdin), it checks a stream of grids on
+//               a pool of threads and reports only the ones that fail.
 //============================================================================
 
 #include <iostream>
-#include <set>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <cstdio>
+#include <cstdint>
+#include "GridValidator.h"
+#include "SudokuPuzzle.h"
+#include "ThreadPool.h"
 using namespace std;
 
-// Check the rows of the puzzle to make sure each entry in the row is both
-// unique and a valid value (int 1 - 9 only).
-// Return value:
-//    true - The rows are OK
-//    false - The rows are NOT OK.  There is either an invalid value in one
-//            or more rows, or a duplicate within one or more rows.
-bool areRowsOk(int (&puzzle)[9][9]) {
-    // Check rows for valid and non-repeating values.  The non-repeating
-    // aspect will be done by using a set and adding the values to the
-    // set, checking for a return code indicating the value to be added
-    // already exists.
-    std::set<int> values;
-    std::pair<std::set<int>::iterator, bool> rc; // Return code for the insert call.
-    for (int row = 0; row < 9; row++) {
-        // Check the row to make sure it doesn't have any duplicates
-        values.clear();
-        for (int col = 0; col < 9; col++) {
-            int value = puzzle[row][col];
-            if (value < 1 || value > 9) {
-                cout << "row " << row << " has an invalid value: " << value << endl;
-                return false;
-            }
+// The name of a unit as numbered by GridViolations.
+string unitName(const int unit) {
+    if (unit < 9) return "row " + to_string(unit);
+    if (unit < 18) return "col " + to_string(unit - 9);
+    int box = unit - 18;
+    return "Submatrix with starting row " + to_string(3 * (box / 3)) + " and starting column " + to_string(3 * (box % 3));
+}
 
-            rc = values.insert(value);
-            if (!rc.second) { // If insert not successful due to value already being in set
-                cout << "row " << row << " has a repeat value: " << value << endl;
-                return false;
-            }
+// Print everything findViolations() found wrong with the puzzle.
+void printViolations(int (&puzzle)[9][9], const GridViolations& violations) {
+    for (int cell=0; cell < 81; cell++) {
+        if (violations.isBadCell(cell)) {
+            cout << "row " << cell / 9 << " col " << cell % 9 << " has an invalid value: " << puzzle[cell / 9][cell % 9] << '\n';
         }
-        cout << "row " << row << " is OK." << endl;
     }
-    return true;
-}
-
-// Check the columns of the puzzle to make sure each entry in the row is unique.
-// Return value:
-//    true - The columns are OK
-//    false - The columns are NOT OK.  There is a duplicate within one or more columns.
-bool areColumnsOk(int (&puzzle)[9][9]) {
-    // Check columns for valid and non-repeating values
-    std::set<int> values;
-    std::pair<std::set<int>::iterator, bool> rc;
-    for (int col = 0; col < 9; col++) {
-        // Check the col to make sure it doesn't have any duplicates
-        values.clear();
-        for (int row = 0; row < 9; row++) {
-            int value = puzzle[row][col];
-            // Don't need to look for invalid values, since we have checked them all when checking rows,
-            // and  all values are in rows!
-            rc = values.insert(value);
-            if (!rc.second) { // If insert not successful due to value already being in set
-                cout << "col " << col << " has a repeat value: " << value << endl;
-                return false;
+    for (int unit=0; unit < 27; unit++) {
+        for (int value=1; value <= 9; value++) {
+            if ((violations.repeats[unit] >> (value - 1) & 1) != 0) {
+                cout << unitName(unit) << " has a repeat value: " << value << '\n';
             }
         }
-        cout << "col " << col << " is OK." << endl;
     }
-    return true;
 }
 
-// Check the specified submatrix of the puzzle to make sure each entry in the submatrix is unique.
+// Check the given puzzle to see if it is a valid solution, in one pass over the
+// cells, printing every problem found.
 // Return value:
-//    true - The submatrix is OK
-//    false - The submatrix are NOT OK.  There is a duplicate within the submatrix.
-bool isSubmatrixOk(int (&puzzle)[9][9], int startRowIdx, int stopRowIdx, int startColIdx, int stopColIdx) {
-    std::set<int> values;
-    std::pair<std::set<int>::iterator, bool> rc;
-    values.clear(); // Probably isn't necessary
-    for (int row = startRowIdx; row <= stopRowIdx; row++) {
-        for (int col = startColIdx; col <= stopColIdx; col++) {
-            int value = puzzle[row][col];
-            rc = values.insert(value);
-            if (!rc.second) {
-                cout << "Submatrix with starting row " << startRowIdx << " and starting column " << startColIdx
-                        << " has a repeat value: " << value << endl;
-                return false;
+//    true - The puzzle contains a valid solution.
+//    false - The puzzle does NOT contain a valid solution.
+bool isSolutionOk(int (&puzzle)[9][9]) {
+    GridViolations violations;
+    if (findViolations(&puzzle[0][0], violations))
+        return true;
+    printViolations(puzzle, violations);
+    return false;
+}
+
+// One line for a grid that failed: its index in the input and everything wrong with it,
+// e.g. "12: row 3 col 4 has invalid value 0; col 4 repeats 7".
+void appendFailure(string& out, const size_t index, const uint8_t* grid, const GridViolations& violations) {
+    out += to_string(index);
+    const char* sep = ": ";
+    for (int cell=0; cell < 81; cell++) {
+        if (violations.isBadCell(cell)) {
+            out += sep;
+            out += "row " + to_string(cell / 9) + " col " + to_string(cell % 9) + " has invalid value " +
+                   to_string(grid[cell]);
+            sep = "; ";
+        }
+    }
+    for (int unit=0; unit < 27; unit++) {
+        for (int value=1; value <= 9; value++) {
+            if ((violations.repeats[unit] >> (value - 1) & 1) != 0) {
+                out += sep;
+                out += (unit < 9 ? "row " : unit < 18 ? "col " : "box ") + to_string(unit % 9) + " repeats " +
+                       to_string(value);
+                sep = "; ";
             }
         }
     }
-    cout << "Submatrix with starting row " << startRowIdx << " and starting column " << startColIdx << " is OK." << endl;
-    return true;
+    out += '\n';
 }
 
-// Check the submatrices of the puzzle to make sure each entry in each submatrix is unique.
+// Check every grid in the input (a file, or stdin for "-"), in any of the formats
+// PuzzleReader understands, on a pool of threads.  Grids are read in chunks and each
+// chunk is checked in blocks, first in bulk with validateGrids() and then, for the
+// failures only, with findViolations() for the reasons.  Failures are written to
+// stdout in input order, one line each; a summary goes to stderr.
 // Return value:
-//    true - The submatrices are OK
-//    false - The submatrices are NOT OK.  There is a duplicate within one or more submatrix.
-bool areSubmatricesOk(int (&puzzle)[9][9]) {
-    // Check sub-matrices (the 9 3x3 squares)
-    for (int startRow = 0; startRow < 7; startRow += 3) {
-        for (int startCol = 0; startCol < 7; startCol += 3) {
-            if (!isSubmatrixOk(puzzle, startRow, startRow + 2, startCol, startCol + 2))
-                return false;
+//    0 - every grid was valid
+//    1 - some weren't, or the input couldn't be read
+int validateStream(const string& fn, const unsigned numThreads) {
+    LineSource source;
+    if (!source.open(fn)) {
+        cerr << "Failed to open file: " << fn << endl;
+        return 1;
+    }
+    ios::sync_with_stdio(false);
+    auto start = chrono::steady_clock::now();
+
+    const size_t CHUNK_SIZE = 1 << 16;
+    const size_t BLOCK_SIZE = 1024;
+    const size_t NUM_BLOCKS = CHUNK_SIZE / BLOCK_SIZE;
+    ThreadPool pool(numThreads);
+    PuzzleReader<9> reader(source);
+    vector<uint8_t> grids(CHUNK_SIZE * GRID_BYTES);
+    // Why each grid of the chunk couldn't be read, or empty if it could.
+    vector<string> unreadable(CHUNK_SIZE);
+    vector<string> blockOutput(NUM_BLOCKS);
+    vector<size_t> blockInvalid(NUM_BLOCKS);
+    vector<size_t> blockUnreadable(NUM_BLOCKS);
+    ParseError error;
+    size_t firstIndex = 0;
+    size_t numInvalid = 0;
+    size_t numUnreadable = 0;
+    bool more = true;
+
+    while (more) {
+        size_t count = 0;
+        while (count < CHUNK_SIZE &&
+               (more = reader.next(*reinterpret_cast<uint8_t (*)[GRID_BYTES]>(&grids[count * GRID_BYTES]), error))) {
+            if (!error.ok()) unreadable[count] = describe(error);
+            else unreadable[count].clear();
+            count++;
         }
+
+        const size_t numBlocks = (count + BLOCK_SIZE - 1) / BLOCK_SIZE;
+        pool.forEach(numBlocks, [&](size_t block, unsigned) {
+            const size_t first = block * BLOCK_SIZE;
+            const size_t num = min(BLOCK_SIZE, count - first);
+            uint64_t passed[BLOCK_SIZE / 64] = {};
+            validateGrids(&grids[first * GRID_BYTES], num, passed);
+            string& out = blockOutput[block];
+            out.clear();
+            blockInvalid[block] = blockUnreadable[block] = 0;
+            for (size_t idx = first; idx < first + num; idx++) {
+                if (!unreadable[idx].empty()) {
+                    out += to_string(firstIndex + idx) + ": " + unreadable[idx] + '\n';
+                    blockUnreadable[block]++;
+                }
+                else if ((passed[(idx - first) / 64] >> ((idx - first) % 64) & 1) == 0) {
+                    GridViolations violations;
+                    findViolations(&grids[idx * GRID_BYTES], violations);
+                    appendFailure(out, firstIndex + idx, &grids[idx * GRID_BYTES], violations);
+                    blockInvalid[block]++;
+                }
+            }
+        });
+
+        // In input order, whichever worker checked them.
+        for (size_t block=0; block < numBlocks; block++) {
+            fwrite(blockOutput[block].data(), 1, blockOutput[block].size(), stdout);
+            numInvalid += blockInvalid[block];
+            numUnreadable += blockUnreadable[block];
+        }
+        firstIndex += count;
     }
-    return true;
+    fflush(stdout);
+
+    const double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    // Every record counts, readable or not, so with one grid per line the count matches
+    // the lines of input (less comments and blank lines).
+    fprintf(stderr, "Checked %zu grids from %ld lines: %zu valid, %zu invalid, %zu unreadable in %.3fs "
+            "(%.0f grids/s, %s, %u threads)\n",
+            firstIndex, reader.lineNumber(), firstIndex - numInvalid - numUnreadable, numInvalid, numUnreadable, seconds,
+            seconds > 0 ? double(firstIndex) / seconds : 0.0, validatorName(bestValidator()), pool.size());
+    return numInvalid + numUnreadable == 0 ? 0 : 1;
 }
 
-// Check the given puzzle to see if it is a valid solution.
-// Return value:
-//    true - The puzzle contains a valid solution.
-//    false - The puzzle does NOT contain a valid solution.
-bool isSolutionOk(int (&puzzle)[9][9]) {
-    if (!areRowsOk(puzzle))
-        return false;
-    if (!areColumnsOk(puzzle))
-        return false;
-    return areSubmatricesOk(puzzle);
+void printUsage() {
+    cerr << "Usage: SudokuValidator                     Check the example solutions" << endl;
+    cerr << "       SudokuValidator [--threads N] FILE  Check every grid in FILE (- for stdin)" << endl;
+    cerr << "Grids are one per line (81 values), nine lines of nine, or nine lines of comma" << endl;
+    cerr << "separated values.  Failing grids are listed by index from zero with their problems." << endl;
 }
 
-int main() {
+// Check the three example solutions, printing each problem found.
+void runExamples() {
 
     // A solution to be tested that passes the row and column
     // tests but not the submatrices test.
@@ -165,6 +223,32 @@ int main() {
     cout << "Solution to puzzle2 is " << (isSolutionOk(puzzle2) ? "" : "NOT ") << "OK." << endl;
 
     cout << "Solution to puzzle3 is " << (isSolutionOk(puzzle3) ? "" : "NOT ") << "OK." << endl;
+}
+
+int main(int argc, char* argv[]) {
+    if (argc == 1) {
+        runExamples();
+        return 0;
+    }
 
-    return 0;
+    string fn;
+    unsigned numThreads = 0;
+    for (int arg=1; arg < argc; arg++) {
+        string opt = argv[arg];
+        if (opt == "--threads" && arg + 1 < argc) {
+            numThreads = unsigned(atoi(argv[++arg]));
+        }
+        else if ((opt == "-" || opt[0] != '-') && fn.empty()) {
+            fn = opt;
+        }
+        else {
+            printUsage();
+            return 2;
+        }
+    }
+    if (fn.empty()) {
+        printUsage();
+        return 2;
+    }
+    return validateStream(fn, numThreads);
 }
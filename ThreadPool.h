@@ -0,0 +1,129 @@
+//============================================================================
+// Name        : ThreadPool.h
+// Author      : Jeff Hancock
+//               https://www.linkedin.com/in/jeffreythancock/
+// Copyright   : Carte blanche.  Plagiarize at will.
+// Description : A fixed set of worker threads, started once and reused for
+//               every batch of work handed to them.
+//============================================================================
+
+#ifndef THREADPOOL_H
+#define THREADPOOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class ThreadPool {
+
+public:
+
+    // Start the worker threads.  Zero means one per hardware thread.
+    explicit ThreadPool(unsigned numThreads = 0) {
+        if (numThreads == 0) numThreads = std::thread::hardware_concurrency();
+        if (numThreads == 0) numThreads = 1;
+        for (unsigned worker=0; worker < numThreads; worker++) {
+            workers.emplace_back([this, worker] { workerLoop(worker); });
+        }
+    }
+
+    // Not copyable or movable; the workers hold on to this.
+    ThreadPool(const ThreadPool& from) = delete;
+    ThreadPool& operator=(const ThreadPool& from) = delete;
+
+    // Stop and join the worker threads.
+    ~ThreadPool() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        workAvailable.notify_all();
+        for (std::thread& thread : workers) {
+            thread.join();
+        }
+    }
+
+    // The number of worker threads.
+    unsigned size() const {
+        return unsigned(workers.size());
+    }
+
+    // Call task(index, worker) for every index from 0 to count - 1, spread across the
+    // workers, and wait until they have all returned.  worker is 0 to size() - 1 and
+    // identifies the thread making the call, for per-thread scratch space.  Indices
+    // are handed out blockSize at a time, which keeps the workers from fighting over
+    // them when each task is quick; for long tasks, 1 keeps one worker from being left
+    // with a block of them while the rest sit idle.  Only one forEach may run at a time.
+    void forEach(const size_t count, const std::function<void(size_t, unsigned)>& task,
+                 const size_t blockSize = DEFAULT_BLOCK_SIZE) {
+        if (count == 0) return;
+        std::unique_lock<std::mutex> lock(mutex);
+        currentTask = &task;
+        taskCount = count;
+        taskBlockSize = blockSize != 0 ? blockSize : 1;
+        nextIndex = 0;
+        busyWorkers = unsigned(workers.size());
+        generation++;
+        workAvailable.notify_all();
+        workDone.wait(lock, [this] { return busyWorkers == 0; });
+        currentTask = nullptr;
+    }
+
+    static const size_t DEFAULT_BLOCK_SIZE = 16;
+
+private:
+
+    std::vector<std::thread> workers;
+
+    std::mutex mutex;
+    std::condition_variable workAvailable;
+    std::condition_variable workDone;
+
+    // The current forEach call.  generation changes each time a new one starts.
+    const std::function<void(size_t, unsigned)>* currentTask = nullptr;
+    size_t taskCount = 0;
+    size_t taskBlockSize = DEFAULT_BLOCK_SIZE;
+    std::atomic<size_t> nextIndex{0};
+    unsigned busyWorkers = 0;
+    unsigned long generation = 0;
+    bool stopping = false;
+
+    void workerLoop(const unsigned worker) {
+        unsigned long seenGeneration = 0;
+        while (true) {
+            const std::function<void(size_t, unsigned)>* task;
+            size_t count;
+            size_t blockSize;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                workAvailable.wait(lock, [&] { return stopping || generation != seenGeneration; });
+                if (stopping) return;
+                seenGeneration = generation;
+                task = currentTask;
+                count = taskCount;
+                blockSize = taskBlockSize;
+            }
+
+            while (true) {
+                size_t first = nextIndex.fetch_add(blockSize);
+                if (first >= count) break;
+                size_t last = (first + blockSize < count) ? first + blockSize : count;
+                for (size_t index=first; index < last; index++) {
+                    (*task)(index, worker);
+                }
+            }
+
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                if (--busyWorkers == 0) workDone.notify_one();
+            }
+        }
+    }
+
+};
+
+#endif // THREADPOOL_H